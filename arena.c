@@ -0,0 +1,86 @@
+#include <stdbool.h> // for bool
+#include <string.h> // For memcpy()
+#include "arena.h"
+
+// enough for pointers and 64-bit integers
+#define ALIGNMENT 8
+#define ALIGN(SIZE) (((SIZE) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+#define BLOCK_HEADER_SIZE ALIGN (sizeof (ArenaBlock))
+
+/**
+ * Add a new block, that fits at least size bytes, to the arena. Blocks of
+ * allocations larger than a quarter of ARENA_BLOCK_SIZE are linked behind
+ * the current block, so that the rest of it can still be used.
+ * @return the new block, NULL in case of allocation failure.
+ */
+static ArenaBlock *add_block (Arena *arena, size_t size)
+{
+  bool dedicated = size > ARENA_BLOCK_SIZE / 4 && arena->blocks;
+  size_t block_size = dedicated || size > ARENA_BLOCK_SIZE ? size
+                                                          : ARENA_BLOCK_SIZE;
+  ArenaBlock *block = malloc (BLOCK_HEADER_SIZE + block_size);
+  if (!block)
+    {
+      return NULL;
+    }
+  if (dedicated)
+    {
+      *block = (ArenaBlock) {arena->blocks->next, block_size, 0};
+      arena->blocks->next = block;
+    }
+  else
+    {
+      *block = (ArenaBlock) {arena->blocks, block_size, 0};
+      arena->blocks = block;
+    }
+  return block;
+}
+
+void *allocate_from_arena (Arena *arena, size_t size)
+{
+  size = ALIGN (size);
+  ArenaBlock *block = arena->blocks;
+  if (!block || block->size - block->used < size)
+    {
+      block = add_block (arena, size);
+      if (!block)
+        {
+          return NULL;
+        }
+    }
+  void *ptr = (char *) block + BLOCK_HEADER_SIZE + block->used;
+  block->used += size;
+  return ptr;
+}
+
+void free_arena (Arena *arena)
+{
+  ArenaBlock *block = arena->blocks;
+  while (block)
+    {
+      ArenaBlock *next = block->next;
+      free (block);
+      block = next;
+    }
+  arena->blocks = NULL;
+}
+
+char *intern_string (Arena *arena, const char *str, size_t length)
+{
+  size_t *header = allocate_from_arena (arena,
+                                        sizeof (size_t) + length + 1);
+  if (!header)
+    {
+      return NULL;
+    }
+  *header = length;
+  char *copy = (char *) (header + 1);
+  memcpy (copy, str, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+size_t get_interned_length (const char *str)
+{
+  return ((const size_t *) str)[-1];
+}
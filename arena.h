@@ -0,0 +1,51 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+#include <stdlib.h> // For malloc()
+
+#define ARENA_BLOCK_SIZE 65536
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+/**
+ * A bump allocator: memory is handed out of large blocks, and only freed
+ * all at once by free_arena. A zero initialized Arena is empty.
+ */
+typedef struct Arena {
+    ArenaBlock *blocks;
+} Arena;
+
+/**
+ * Allocate size bytes out of the arena, aligned to 8 bytes.
+ * @param arena the arena to allocate from
+ * @param size number of bytes
+ * @return pointer to the memory, NULL in case of allocation failure.
+ */
+void *allocate_from_arena (Arena *arena, size_t size);
+
+/**
+ * Free all the memory allocated out of the arena, leaving it empty.
+ * @param arena the arena to free
+ */
+void free_arena (Arena *arena);
+
+/**
+ * Copy length bytes of str into the arena as a null terminated string,
+ * with its length stored right before it.
+ * @param arena the arena to allocate from
+ * @param str the string to copy, doesn't have to be null terminated
+ * @param length length of the string
+ * @return the copy, NULL in case of allocation failure.
+ */
+char *intern_string (Arena *arena, const char *str, size_t length);
+
+/**
+ * @param str a string returned by intern_string
+ * @return the length of str, without calling strlen
+ */
+size_t get_interned_length (const char *str);
+
+#endif //_ARENA_H_
@@ -0,0 +1,332 @@
+#include "batch_generator.h"
+#include <pthread.h>
+
+#define MIN_SEQUENCE_LENGTH 2
+
+/**
+ * The sequences of a chunk, once a thread generated them: sequence i of the
+ * chunk is lengths[i] states long, starting at states[i * max_length].
+ */
+typedef struct Chunk {
+    uint32_t *states;
+    int *lengths;
+    bool done;
+} Chunk;
+
+/**
+ * The chunks left for a thread, chunks[head] to chunks[tail - 1] in order.
+ * The thread takes chunks from the head, and thieves from the tail.
+ */
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    int *chunks;
+    int head;
+    int tail;
+} WorkQueue;
+
+typedef struct Batch {
+    const FrozenChain *frozen_chain;
+    uint64_t seed;
+    int sequences_num;
+    int max_length;
+
+    Chunk *chunks;
+    int chunks_num;
+
+    WorkQueue *queues;
+    int workers_num;
+
+    // guards done of every chunk, failed and emitted
+    pthread_mutex_t done_lock;
+    pthread_cond_t done_cond;
+    bool failed;
+
+    // number of chunks emitted so far. Chunk i is only generated once
+    // i < emitted + window, signaled by window_cond
+    int emitted;
+    int window;
+    pthread_cond_t window_cond;
+} Batch;
+
+typedef struct Worker {
+    Batch *batch;
+    int id;
+} Worker;
+
+/**
+ * Take a chunk from the head of the queue (own is true) or its tail.
+ * @return index of the chunk, -1 if the queue is empty.
+ */
+static int take_chunk (WorkQueue *queue, bool own)
+{
+  int chunk = -1;
+  pthread_mutex_lock (&queue->lock);
+  if (queue->head < queue->tail)
+    {
+      chunk = own ? queue->chunks[queue->head++]
+                  : queue->chunks[--queue->tail];
+    }
+  pthread_mutex_unlock (&queue->lock);
+  return chunk;
+}
+
+/**
+ * Take the next chunk for worker id: from its own queue, or stolen from
+ * another one.
+ * @return index of the chunk, -1 if there is no work left.
+ */
+static int get_next_chunk (Batch *batch, int id)
+{
+  int chunk = take_chunk (&batch->queues[id], true);
+  for (int i = 1; chunk < 0 && i < batch->workers_num; ++i)
+    {
+      chunk = take_chunk (&batch->queues[(id + i) % batch->workers_num],
+                          false);
+    }
+  return chunk;
+}
+
+/**
+ * Generate the sequences of a chunk, and mark it done.
+ */
+static void run_chunk (Batch *batch, int index)
+{
+  Chunk *chunk = &batch->chunks[index];
+  int first = index * BATCH_CHUNK_SIZE;
+  int count = batch->sequences_num - first < BATCH_CHUNK_SIZE
+              ? batch->sequences_num - first : BATCH_CHUNK_SIZE;
+  chunk->states = malloc ((size_t) count * batch->max_length
+                          * sizeof (uint32_t));
+  chunk->lengths = malloc ((size_t) count * sizeof (int));
+  if (chunk->states && chunk->lengths)
+    {
+      const FrozenChain *frozen_chain = batch->frozen_chain;
+      for (int i = 0; i < count; ++i)
+        {
+          Rng rng;
+          seed_rng (&rng, batch->seed, (uint64_t) (first + i));
+          chunk->lengths[i] = walk_frozen_chain (
+              frozen_chain, get_first_frozen_state (frozen_chain, &rng),
+              batch->max_length, &rng,
+              chunk->states + (size_t) i * batch->max_length);
+        }
+    }
+  pthread_mutex_lock (&batch->done_lock);
+  if (!chunk->states || !chunk->lengths)
+    {
+      batch->failed = true;
+    }
+  chunk->done = true;
+  pthread_cond_broadcast (&batch->done_cond);
+  pthread_mutex_unlock (&batch->done_lock);
+}
+
+/**
+ * Wait until the chunk is within the window of chunks that may be
+ * generated ahead of the emitter.
+ */
+static void wait_for_window (Batch *batch, int index)
+{
+  pthread_mutex_lock (&batch->done_lock);
+  while (index >= batch->emitted + batch->window)
+    {
+      pthread_cond_wait (&batch->window_cond, &batch->done_lock);
+    }
+  pthread_mutex_unlock (&batch->done_lock);
+}
+
+/**
+ * A worker thread's routine: run chunks until there are none left.
+ * @param arg the Worker
+ * @return NULL
+ */
+static void *run_worker (void *arg)
+{
+  Worker *worker = arg;
+  int chunk;
+  while ((chunk = get_next_chunk (worker->batch, worker->id)) >= 0)
+    {
+      wait_for_window (worker->batch, chunk);
+      run_chunk (worker->batch, chunk);
+    }
+  return NULL;
+}
+
+/**
+ * Take the chunk from its queue if no thread took it yet. The owner of a
+ * queue takes its chunks in order, and thieves take them from the tail,
+ * so a chunk that wasn't emitted yet, while all the ones before it were,
+ * is either taken or at the head of its queue.
+ * @return true if the chunk was taken from the queue.
+ */
+static bool take_next_chunk (Batch *batch, int index)
+{
+  WorkQueue *queue = &batch->queues[index % batch->workers_num];
+  bool taken = false;
+  pthread_mutex_lock (&queue->lock);
+  if (queue->head < queue->tail && queue->chunks[queue->head] == index)
+    {
+      queue->head++;
+      taken = true;
+    }
+  pthread_mutex_unlock (&queue->lock);
+  return taken;
+}
+
+/**
+ * Emit the chunks in order as they are done, freeing each one after it.
+ * A chunk that no thread took yet is generated right here, so the emitter
+ * never waits on the queue of a worker that didn't get a thread, nor on
+ * workers that wait for the window to move.
+ * @return success/failure: true if all the chunks were emitted, false in
+ * case of allocation error.
+ */
+static bool emit_chunks (Batch *batch, emit_sequence emit_func, void *context)
+{
+  bool failed = false;
+  for (int index = 0; index < batch->chunks_num; ++index)
+    {
+      Chunk *chunk = &batch->chunks[index];
+      if (take_next_chunk (batch, index))
+        {
+          run_chunk (batch, index);
+        }
+      pthread_mutex_lock (&batch->done_lock);
+      while (!chunk->done)
+        {
+          pthread_cond_wait (&batch->done_cond, &batch->done_lock);
+        }
+      failed = failed || batch->failed;
+      pthread_mutex_unlock (&batch->done_lock);
+      int first = index * BATCH_CHUNK_SIZE;
+      for (int i = 0; !failed && i < BATCH_CHUNK_SIZE
+                      && first + i < batch->sequences_num; ++i)
+        {
+          emit_func (context, first + i,
+                     chunk->states + (size_t) i * batch->max_length,
+                     chunk->lengths[i]);
+        }
+      free (chunk->states);
+      free (chunk->lengths);
+      pthread_mutex_lock (&batch->done_lock);
+      batch->emitted = index + 1;
+      pthread_cond_broadcast (&batch->window_cond);
+      pthread_mutex_unlock (&batch->done_lock);
+    }
+  return !failed;
+}
+
+/**
+ * Allocate the chunks and the queues of the workers, dealing the chunks
+ * out round robin, so that the workers go through them roughly in the
+ * order they are emitted.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool init_batch (Batch *batch)
+{
+  batch->chunks = calloc (batch->chunks_num, sizeof (Chunk));
+  batch->queues = calloc (batch->workers_num, sizeof (WorkQueue));
+  int *chunks = malloc (batch->chunks_num * sizeof (int));
+  if (!batch->chunks || !batch->queues || !chunks)
+    {
+      free (batch->chunks);
+      free (batch->queues);
+      free (chunks);
+      return false;
+    }
+  int position = 0;
+  for (int id = 0; id < batch->workers_num; ++id)
+    {
+      WorkQueue *queue = &batch->queues[id];
+      pthread_mutex_init (&queue->lock, NULL);
+      queue->chunks = chunks + position;
+      for (int chunk = id; chunk < batch->chunks_num;
+           chunk += batch->workers_num)
+        {
+          queue->chunks[queue->tail++] = chunk;
+        }
+      position += queue->tail;
+    }
+  pthread_mutex_init (&batch->done_lock, NULL);
+  pthread_cond_init (&batch->done_cond, NULL);
+  pthread_cond_init (&batch->window_cond, NULL);
+  return true;
+}
+
+static void free_batch (Batch *batch)
+{
+  for (int id = 0; id < batch->workers_num; ++id)
+    {
+      pthread_mutex_destroy (&batch->queues[id].lock);
+    }
+  pthread_mutex_destroy (&batch->done_lock);
+  pthread_cond_destroy (&batch->done_cond);
+  pthread_cond_destroy (&batch->window_cond);
+  // the queues share a single array of chunks
+  free (batch->queues[0].chunks);
+  free (batch->queues);
+  free (batch->chunks);
+}
+
+bool generate_frozen_batch (const FrozenChain *frozen_chain,
+                            uint64_t seed,
+                            int sequences_num,
+                            int max_length,
+                            int threads,
+                            emit_sequence emit_func,
+                            void *context)
+{
+  if (sequences_num <= 0)
+    {
+      return true;
+    }
+  Batch batch = {0};
+  batch.frozen_chain = frozen_chain;
+  batch.seed = seed;
+  batch.sequences_num = sequences_num;
+  batch.max_length = max_length < MIN_SEQUENCE_LENGTH ? MIN_SEQUENCE_LENGTH
+                                                      : max_length;
+  batch.chunks_num = (sequences_num + BATCH_CHUNK_SIZE - 1)
+                     / BATCH_CHUNK_SIZE;
+  batch.workers_num = threads < 1 ? 1 : threads;
+  if (batch.workers_num > batch.chunks_num)
+    {
+      batch.workers_num = batch.chunks_num;
+    }
+  batch.window = batch.workers_num * BATCH_WINDOW_PER_THREAD;
+  pthread_t *pool = malloc (batch.workers_num * sizeof (pthread_t));
+  Worker *workers = malloc (batch.workers_num * sizeof (Worker));
+  if (!pool || !workers || !init_batch (&batch))
+    {
+      free (pool);
+      free (workers);
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return false;
+    }
+
+  int started = 0;
+  for (int id = 0; id < batch.workers_num; ++id)
+    {
+      workers[id] = (Worker) {&batch, id};
+      if (pthread_create (&pool[started], NULL, run_worker,
+                          &workers[id]) == 0)
+        {
+          started++;
+        }
+    }
+  bool success = emit_chunks (&batch, emit_func, context);
+  for (int i = 0; i < started; ++i)
+    {
+      pthread_join (pool[i], NULL);
+    }
+
+  free_batch (&batch);
+  free (pool);
+  free (workers);
+  if (!success)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    }
+  return success;
+}
@@ -0,0 +1,42 @@
+#ifndef _BATCH_GENERATOR_H_
+#define _BATCH_GENERATOR_H_
+#include "frozen_chain.h"
+
+#define BATCH_CHUNK_SIZE 256
+#define BATCH_WINDOW_PER_THREAD 4
+
+// pointer to a func that gets the context given to generate_frozen_batch,
+// the index of a sequence and the ids of its states, and outputs it.
+// returns void.
+typedef void (*emit_sequence)(void *context, int index,
+                              const uint32_t *states, int length);
+
+/**
+ * Generate sequences_num random sequences out of frozen_chain on a pool of
+ * threads, and emit them in order on the calling thread.
+ * Sequence i is walked with its own random stream (stream i of seed), so
+ * the output only depends on the seed, not on the number of threads.
+ * Sequences are handed out in chunks of BATCH_CHUNK_SIZE: every thread
+ * starts with its own queue of chunks, and steals from the queues of the
+ * others once it runs out. A thread only generates a chunk once it is
+ * less than BATCH_WINDOW_PER_THREAD chunks per thread ahead of the one
+ * being emitted, so the memory taken doesn't grow with sequences_num.
+ * @param frozen_chain the chain to walk, read only
+ * @param seed the seed of the random streams
+ * @param sequences_num number of sequences to generate
+ * @param max_length maximum length of a sequence
+ * @param threads number of threads to generate on
+ * @param emit_func called with every sequence, in order of index
+ * @param context passed to emit_func
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error (some of the sequences may have been emitted).
+ */
+bool generate_frozen_batch (const FrozenChain *frozen_chain,
+                            uint64_t seed,
+                            int sequences_num,
+                            int max_length,
+                            int threads,
+                            emit_sequence emit_func,
+                            void *context);
+
+#endif /* _BATCH_GENERATOR_H_ */
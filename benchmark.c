@@ -0,0 +1,481 @@
+#define _POSIX_C_SOURCE 199309L // For clock_gettime()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "benchmark_words.h"
+#include "markov_chain_specialize.h"
+
+#define USAGE_ERR_MSG "USAGE: benchmark [max tokens] [corpus file] [scale]\n"
+#define FILE_ERR_MSG "ERROR: The given file is invalid.\n"
+#define DECIMAL_BASE 10
+#define MAX_ARGS_NUM 4
+#define DEFAULT_MAX_TOKENS 1000000
+#define DEFAULT_SCALE 100
+#define MIN_TOKENS 10000
+#define TOKENS_GROWTH 2
+#define TOKENS_PER_WORD 10
+#define LINEAR_SCAN_MAX_TOKENS 40000
+#define DELIMITERS " \n\r"
+#define FNV_OFFSET_BASIS 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+#define BOARD_SIZE 100
+#define DICE_MAX 6
+#define EMPTY -1
+
+/**
+ * A cell of a snakes and ladders board, like snakes_and_ladders.c's.
+ */
+typedef struct Cell {
+    int number;
+    int ladder_to;
+    int snake_to;
+} Cell;
+
+/**
+ * How the chain looks states up: scanning the database, through the hash
+ * index with the generic callbacks, or with DEFINE_SPECIALIZED_CHAIN.
+ */
+typedef enum Lookup {
+    LINEAR,
+    HASH,
+    SPECIALIZED
+} Lookup;
+
+static const char *lookup_names[] = {"linear", "hash", "special"};
+
+/**
+ * How long building a chain, and then freeing it, took.
+ */
+typedef struct Timing {
+    double build;
+    double teardown;
+} Timing;
+
+static int run_scaling (int max_tokens);
+static int run_corpus (char *path, int scale);
+static int run_cells (int max_tokens);
+static int read_corpus (Corpus *corpus, char *path, int scale);
+static bool build_chain (Corpus *corpus, Lookup lookup, Timing *timing);
+static bool build_cell_chain (Cell **cells, int length, Lookup lookup,
+                              Timing *timing);
+
+// functions for generic implementation
+static void print_cell (void *data);
+static int compare_cells (void *ptr1, void *ptr2);
+static void *copy_cell (void *ptr);
+static bool is_last_cell (void *ptr);
+static unsigned long hash_cell (void *ptr);
+
+// the same functions, specialized
+static inline unsigned long hash_text (const char *text)
+{
+  unsigned long hash = FNV_OFFSET_BASIS;
+  for (const unsigned char *c = (const unsigned char *) text; *c; ++c)
+    {
+      hash = (hash ^ *c) * FNV_PRIME;
+    }
+  return hash;
+}
+
+static inline int compare_text (const char *text1, const char *text2)
+{
+  return strcmp (text1, text2);
+}
+
+static inline unsigned long hash_cell_number (const Cell *cell)
+{
+  return (unsigned long) cell->number;
+}
+
+static inline int compare_cell_numbers (const Cell *cell1, const Cell *cell2)
+{
+  return cell1->number - cell2->number;
+}
+
+DEFINE_SPECIALIZED_CHAIN (words, char, char, hash_text, compare_text)
+DEFINE_SPECIALIZED_CHAIN (cells, Cell, Cell, hash_cell_number,
+                          compare_cell_numbers)
+
+/**
+ * Measures the time it takes to build a chain out of synthetic corpora of
+ * growing size, with and without the hash index, and prints the time per
+ * token of each run, and the same for a chain of snakes and ladders cells.
+ * If a corpus file is given, also measures building and freeing a chain out
+ * of it, repeated scale times.
+ * @param argc num of arguments
+ * @param argv 1) max number of tokens (optional)
+ *             2) corpus file (optional)
+ *             3) number of times to repeat the corpus (optional)
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int main (int argc, char *argv[])
+{
+  if (argc > MAX_ARGS_NUM)
+    {
+      fprintf (stderr, USAGE_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+  int max_tokens = argc > 1
+                   ? (int) strtol (argv[1], NULL, DECIMAL_BASE)
+                   : DEFAULT_MAX_TOKENS;
+  int scale = argc > 3
+              ? (int) strtol (argv[3], NULL, DECIMAL_BASE)
+              : DEFAULT_SCALE;
+  if (run_scaling (max_tokens) != EXIT_SUCCESS
+      || run_cells (max_tokens) != EXIT_SUCCESS)
+    {
+      return EXIT_FAILURE;
+    }
+  if (argc > 2)
+    {
+      return run_corpus (argv[2], scale);
+    }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Build chains out of synthetic corpora of doubling size, up to max_tokens.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int run_scaling (int max_tokens)
+{
+  Rng rng;
+  seed_rng (&rng, 0, 0);
+  printf ("%-10s %-8s %12s %14s\n", "tokens", "lookup", "seconds",
+          "ns/token");
+  for (int tokens_num = MIN_TOKENS; tokens_num <= max_tokens;
+       tokens_num *= TOKENS_GROWTH)
+    {
+      Corpus corpus;
+      if (create_corpus (&corpus, tokens_num, tokens_num / TOKENS_PER_WORD,
+                         0, &rng) != EXIT_SUCCESS)
+        {
+          return EXIT_FAILURE;
+        }
+      for (int lookup = SPECIALIZED; lookup >= LINEAR; --lookup)
+        {
+          if (lookup == LINEAR && tokens_num > LINEAR_SCAN_MAX_TOKENS)
+            {
+              continue;
+            }
+          Timing timing;
+          if (!build_chain (&corpus, lookup, &timing))
+            {
+              free_corpus (&corpus);
+              return EXIT_FAILURE;
+            }
+          printf ("%-10d %-8s %12.4f %14.1f\n", tokens_num,
+                  lookup_names[lookup], timing.build,
+                  timing.build * NANOS_IN_SECOND / tokens_num);
+        }
+      free_corpus (&corpus);
+    }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Build a chain out of the corpus file repeated scale times, and free it.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int run_corpus (char *path, int scale)
+{
+  Corpus corpus;
+  if (read_corpus (&corpus, path, scale) != EXIT_SUCCESS)
+    {
+      return EXIT_FAILURE;
+    }
+  printf ("\n%s x%d: %ld tokens\n", path, scale, corpus.tokens_num);
+  for (int lookup = SPECIALIZED; lookup >= HASH; --lookup)
+    {
+      Timing timing;
+      if (!build_chain (&corpus, lookup, &timing))
+        {
+          free_corpus (&corpus);
+          return EXIT_FAILURE;
+        }
+      printf ("%-8s build    %10.4f s %10.1f ns/token\n",
+              lookup_names[lookup], timing.build,
+              timing.build * NANOS_IN_SECOND / corpus.tokens_num);
+      printf ("%-8s teardown %10.4f s %10.1f ns/token\n",
+              lookup_names[lookup], timing.teardown,
+              timing.teardown * NANOS_IN_SECOND / corpus.tokens_num);
+    }
+  free_corpus (&corpus);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Build chains out of random games of snakes and ladders, max_tokens cells
+ * long in total, with the generic and the specialized lookups.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int run_cells (int max_tokens)
+{
+  Cell board[BOARD_SIZE];
+  for (int i = 0; i < BOARD_SIZE; ++i)
+    {
+      board[i] = (Cell) {i + 1, EMPTY, EMPTY};
+    }
+  // a ladder every 9 cells and a snake every 11, like a real board has
+  for (int i = 3; i < BOARD_SIZE - 10; i += 9)
+    {
+      board[i].ladder_to = i + 10;
+    }
+  for (int i = 16; i < BOARD_SIZE - 1; i += 11)
+    {
+      board[i].snake_to = i - 12;
+    }
+  Cell **cells = malloc ((size_t) max_tokens * sizeof (Cell *));
+  if (!cells)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return EXIT_FAILURE;
+    }
+  Rng rng;
+  seed_rng (&rng, 0, 1);
+  int position = 0;
+  for (int i = 0; i < max_tokens; ++i)
+    {
+      cells[i] = &board[position];
+      if (position == BOARD_SIZE - 1)
+        {
+          // start the next game
+          cells[i] = NULL;
+          position = 0;
+          continue;
+        }
+      int to = board[position].ladder_to != EMPTY ? board[position].ladder_to
+               : board[position].snake_to != EMPTY ? board[position].snake_to
+               : position + 1 + get_random_number (&rng, DICE_MAX);
+      position = to < BOARD_SIZE ? to : BOARD_SIZE - 1;
+    }
+
+  printf ("\ncells: %d tokens\n", max_tokens);
+  for (int lookup = SPECIALIZED; lookup >= HASH; --lookup)
+    {
+      Timing timing;
+      if (!build_cell_chain (cells, max_tokens, lookup, &timing))
+        {
+          free (cells);
+          return EXIT_FAILURE;
+        }
+      printf ("%-8s build    %10.4f s %10.1f ns/token\n",
+              lookup_names[lookup], timing.build,
+              timing.build * NANOS_IN_SECOND / max_tokens);
+    }
+  free (cells);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Read a corpus file, splitting it to words like tweets_generator does,
+ * and repeat its tokens scale times.
+ * @param corpus the corpus to fill
+ * @param path the corpus file
+ * @param scale number of times to repeat the file
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int read_corpus (Corpus *corpus, char *path, int scale)
+{
+  *corpus = (Corpus) {NULL, NULL, 0, 0};
+  FILE *fp = fopen (path, "rb");
+  if (!fp || fseek (fp, 0, SEEK_END) != 0)
+    {
+      fprintf (stderr, FILE_ERR_MSG);
+      if (fp)
+        {
+          fclose (fp);
+        }
+      return EXIT_FAILURE;
+    }
+  long size = ftell (fp);
+  rewind (fp);
+  corpus->words = malloc (size + 1);
+  // at most one word and one end of line per two bytes, and a final NULL
+  corpus->tokens = malloc (((size_t) size + 2) * sizeof (char *) * scale);
+  if (!corpus->words || !corpus->tokens
+      || fread (corpus->words, 1, size, fp) != (size_t) size)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      fclose (fp);
+      free_corpus (corpus);
+      return EXIT_FAILURE;
+    }
+  fclose (fp);
+  corpus->words[size] = '\0';
+
+  for (char *line = strtok (corpus->words, "\n"); line;
+       line = strtok (NULL, "\n"))
+    {
+      char *end = line + strlen (line);
+      for (char *word = line; word < end; ++word)
+        {
+          size_t word_len = strcspn (word, DELIMITERS);
+          if (word_len > 0)
+            {
+              word[word_len] = '\0';
+              corpus->tokens[corpus->length++] = word;
+              word += word_len;
+            }
+        }
+      corpus->tokens[corpus->length++] = NULL;
+    }
+  corpus->tokens_num = 0;
+  for (long i = 0; i < corpus->length; ++i)
+    {
+      corpus->tokens_num += corpus->tokens[i] != NULL;
+    }
+  for (int i = 1; i < scale; ++i)
+    {
+      memcpy (corpus->tokens + (size_t) i * corpus->length, corpus->tokens,
+              corpus->length * sizeof (char *));
+    }
+  corpus->length *= scale;
+  corpus->tokens_num *= scale;
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Build a chain out of the corpus, the same way tweets_generator does, and
+ * free it.
+ * @param corpus the corpus to read
+ * @param lookup how to look the words up
+ * @param timing the timing to fill
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool build_chain (Corpus *corpus, Lookup lookup, Timing *timing)
+{
+  MarkovChain *markov_chain = create_word_chain ();
+  if (!markov_chain)
+    {
+      return false;
+    }
+  if (lookup == LINEAR)
+    {
+      markov_chain->hash_func = NULL;
+    }
+
+  double start = get_time ();
+  Node *prev = NULL;
+  for (long i = 0; i < corpus->length; ++i)
+    {
+      if (!corpus->tokens[i])
+        {
+          prev = NULL;
+          continue;
+        }
+      Node *curr = lookup == SPECIALIZED
+                   ? words_add_to_database (markov_chain, corpus->tokens[i])
+                   : add_to_database (markov_chain, corpus->tokens[i]);
+      if (!curr)
+        {
+          return false;
+        }
+      if (prev && !add_node_to_counter_list (prev->data, curr->data,
+                                             markov_chain))
+        {
+          free_markov_chain (&markov_chain);
+          return false;
+        }
+      prev = curr;
+    }
+  timing->build = get_time () - start;
+
+  start = get_time ();
+  free_markov_chain (&markov_chain);
+  timing->teardown = get_time () - start;
+  return true;
+}
+
+/**
+ * Build a chain out of the cells, where a NULL cell ends a game, and free
+ * it.
+ * @param cells the cells to read
+ * @param length number of cells
+ * @param lookup how to look the cells up (not LINEAR)
+ * @param timing the timing to fill
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool build_cell_chain (Cell **cells, int length, Lookup lookup,
+                              Timing *timing)
+{
+  MarkovChain *markov_chain = create_markov_chain ();
+  if (!markov_chain)
+    {
+      return false;
+    }
+  markov_chain->print_func = print_cell;
+  markov_chain->comp_func = compare_cells;
+  markov_chain->free_data = free;
+  markov_chain->copy_func = copy_cell;
+  markov_chain->is_last = is_last_cell;
+  markov_chain->hash_func = hash_cell;
+
+  double start = get_time ();
+  Node *prev = NULL;
+  for (int i = 0; i < length; ++i)
+    {
+      if (!cells[i])
+        {
+          prev = NULL;
+          continue;
+        }
+      Node *curr = lookup == SPECIALIZED
+                   ? cells_add_to_database (markov_chain, cells[i])
+                   : add_to_database (markov_chain, cells[i]);
+      if (!curr)
+        {
+          return false;
+        }
+      if (prev && !add_node_to_counter_list (prev->data, curr->data,
+                                             markov_chain))
+        {
+          free_markov_chain (&markov_chain);
+          return false;
+        }
+      prev = curr;
+    }
+  timing->build = get_time () - start;
+
+  start = get_time ();
+  free_markov_chain (&markov_chain);
+  timing->teardown = get_time () - start;
+  return true;
+}
+
+// functions for generic implementation
+static void print_cell (void *data)
+{
+  printf ("[%d] ", ((Cell *) data)->number);
+}
+
+static int compare_cells (void *ptr1, void *ptr2)
+{
+  return ((Cell *) ptr1)->number - ((Cell *) ptr2)->number;
+}
+
+static void *copy_cell (void *ptr)
+{
+  Cell *dest = malloc (sizeof (Cell));
+  if (!dest)
+    {
+      return NULL;
+    }
+  *dest = *(Cell *) ptr;
+  return dest;
+}
+
+static bool is_last_cell (void *ptr)
+{
+  return ((Cell *) ptr)->number == BOARD_SIZE;
+}
+
+static unsigned long hash_cell (void *ptr)
+{
+  return (unsigned long) ((Cell *) ptr)->number;
+}
@@ -0,0 +1,691 @@
+#define _POSIX_C_SOURCE 200112L // For clock_gettime() and dup()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "benchmark_words.h"
+#include "concurrent_chain.h"
+#include "snapshot_chain.h"
+
+#define USAGE_ERR_MSG "USAGE: benchmark_suite [--tokens <n>] " \
+                      "[--vocabulary <n>] [--skew <s>] [--seed <n>] " \
+                      "[--sweep <n>] [--corpus <file>] " \
+                      "[--producers <n>] [--snapshots <n>]\n"
+#define FILE_ERR_MSG "ERROR: The given file is invalid.\n"
+#define TOKENS_FLAG "--tokens"
+#define VOCABULARY_FLAG "--vocabulary"
+#define SKEW_FLAG "--skew"
+#define SEED_FLAG "--seed"
+#define SWEEP_FLAG "--sweep"
+#define CORPUS_FLAG "--corpus"
+#define PRODUCERS_FLAG "--producers"
+#define SNAPSHOTS_FLAG "--snapshots"
+#define DECIMAL_BASE 10
+#define DEFAULT_TOKENS 1000000
+#define DEFAULT_VOCABULARY 100000
+#define DEFAULT_SKEW 1.0
+#define MAX_SWEEP 4
+#define MAX_PRODUCERS 64
+#define BASE_MEASUREMENTS 7
+#define MAX_MEASUREMENTS 11
+#define SNAPSHOT_STREAM 1
+#define SWEEP_GROWTH 10
+#define NEXT_NODE_STEPS_PER_TOKEN 1
+#define SEQUENCES_PER_TOKEN 0.01
+#define MAX_SEQUENCE_LENGTH 20
+
+/**
+ * The parameters of the synthetic corpora.
+ */
+typedef struct SuiteConfig {
+    long tokens_num;
+    int vocabulary_size;
+    double skew;
+    uint64_t seed;
+    // number of runs, each on a corpus SWEEP_GROWTH times the last one's
+    int sweep;
+    // if set, write the first corpus there instead of running
+    char *corpus_path;
+    // number of threads to add to a ConcurrentChain at once, 0 to skip
+    int producers;
+    // number of snapshots to publish while generating, 0 to skip
+    int snapshots;
+} SuiteConfig;
+
+/**
+ * The tokens that a single producer adds to the shared chain.
+ */
+typedef struct Producer {
+    const Corpus *corpus;
+    long begin;
+    long end;
+    ConcurrentChain *concurrent_chain;
+    bool success;
+} Producer;
+
+/**
+ * A thread that generates sequences out of the snapshots of a
+ * SnapshotChain, each one out of the snapshot current when it starts.
+ */
+typedef struct SnapshotGenerator {
+    SnapshotChain *snapshot_chain;
+    SnapshotReader *reader;
+    Rng rng;
+    // stop after this many sequences, or once stop is set if it is -1
+    long max_sequences;
+    bool stop;
+    long sequences;
+    // CPU time of the thread
+    double seconds;
+} SnapshotGenerator;
+
+/**
+ * The result of one microbenchmark.
+ */
+typedef struct Measurement {
+    const char *name;
+    long operations;
+    double seconds;
+} Measurement;
+
+static int parse_args (int argc, char *argv[], SuiteConfig *config);
+static int create_zipf_corpus (Corpus *corpus, const SuiteConfig *config,
+                               long tokens_num);
+static int write_corpus (const Corpus *corpus, const char *path);
+static int run_suite (const Corpus *corpus, const SuiteConfig *config,
+                      bool last);
+static void *produce (void *arg);
+static int measure_concurrent_ingest (const Corpus *corpus,
+                                      const SuiteConfig *config,
+                                      Measurement *measurement);
+static void *generate_from_snapshots (void *arg);
+static int measure_snapshots (const Corpus *corpus, const SuiteConfig *config,
+                              Measurement *measurements);
+static void print_measurement (const Measurement *measurement, bool last);
+static double get_thread_time (void);
+
+/**
+ * Times the main operations of a MarkovChain on synthetic corpora whose
+ * words follow a Zipf distribution, and prints the results as JSON: a run
+ * per corpus size, each with the number of operations, seconds and
+ * nanoseconds per operation of every operation.
+ * @param argc num of arguments
+ * @param argv the optional flags, see parse_args
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int main (int argc, char *argv[])
+{
+  SuiteConfig config;
+  if (parse_args (argc, argv, &config) != EXIT_SUCCESS)
+    {
+      return EXIT_FAILURE;
+    }
+  if (config.corpus_path)
+    {
+      Corpus corpus;
+      if (create_zipf_corpus (&corpus, &config, config.tokens_num)
+          != EXIT_SUCCESS)
+        {
+          return EXIT_FAILURE;
+        }
+      int status = write_corpus (&corpus, config.corpus_path);
+      free_corpus (&corpus);
+      return status;
+    }
+
+  printf ("{\"vocabulary\": %d, \"skew\": %g, \"seed\": %lu, \"runs\": [\n",
+          config.vocabulary_size, config.skew, (unsigned long) config.seed);
+  long tokens_num = config.tokens_num;
+  for (int run = 0; run < config.sweep; ++run)
+    {
+      Corpus corpus;
+      if (create_zipf_corpus (&corpus, &config, tokens_num) != EXIT_SUCCESS
+          || run_suite (&corpus, &config, run == config.sweep - 1)
+             != EXIT_SUCCESS)
+        {
+          free_corpus (&corpus);
+          return EXIT_FAILURE;
+        }
+      free_corpus (&corpus);
+      tokens_num *= SWEEP_GROWTH;
+    }
+  printf ("]}\n");
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Parse the flags: "--tokens <n>" tokens in the first corpus,
+ * "--vocabulary <n>" words in the vocabulary, "--skew <s>" the exponent of
+ * the Zipf distribution (0 for uniform), "--seed <n>", "--sweep <n>"
+ * number of corpus sizes, "--corpus <file>" to write the corpus as
+ * text, for tweets_generator, instead of running, "--producers <n>"
+ * threads to time concurrent ingestion with (see measure_concurrent_ingest),
+ * and "--snapshots <n>" snapshots to publish while generating (see
+ * measure_snapshots).
+ * @param argc num of arguments
+ * @param argv array of pointers to the arguments, flags and their values
+ * @param config the config to fill
+ * @return EXIT_SUCCESS if the arguments are valid, EXIT_FAILURE otherwise.
+ */
+static int parse_args (int argc, char *argv[], SuiteConfig *config)
+{
+  *config = (SuiteConfig) {DEFAULT_TOKENS, DEFAULT_VOCABULARY, DEFAULT_SKEW,
+                           0, 1, NULL, 0, 0};
+  bool valid = argc % 2 == 1;
+  for (int i = 1; valid && i < argc; i += 2)
+    {
+      const char *flag = argv[i];
+      char *value = argv[i + 1];
+      if (strcmp (flag, TOKENS_FLAG) == 0)
+        {
+          config->tokens_num = strtol (value, NULL, DECIMAL_BASE);
+          valid = config->tokens_num > 0;
+        }
+      else if (strcmp (flag, VOCABULARY_FLAG) == 0)
+        {
+          config->vocabulary_size = (int) strtol (value, NULL, DECIMAL_BASE);
+          valid = config->vocabulary_size > 0;
+        }
+      else if (strcmp (flag, SKEW_FLAG) == 0)
+        {
+          config->skew = strtod (value, NULL);
+          valid = config->skew >= 0;
+        }
+      else if (strcmp (flag, SEED_FLAG) == 0)
+        {
+          config->seed = strtoull (value, NULL, DECIMAL_BASE);
+        }
+      else if (strcmp (flag, SWEEP_FLAG) == 0)
+        {
+          config->sweep = (int) strtol (value, NULL, DECIMAL_BASE);
+          valid = config->sweep > 0 && config->sweep <= MAX_SWEEP;
+        }
+      else if (strcmp (flag, CORPUS_FLAG) == 0)
+        {
+          config->corpus_path = value;
+        }
+      else if (strcmp (flag, PRODUCERS_FLAG) == 0)
+        {
+          config->producers = (int) strtol (value, NULL, DECIMAL_BASE);
+          valid = config->producers > 0
+                  && config->producers <= MAX_PRODUCERS;
+        }
+      else if (strcmp (flag, SNAPSHOTS_FLAG) == 0)
+        {
+          config->snapshots = (int) strtol (value, NULL, DECIMAL_BASE);
+          valid = config->snapshots > 0;
+        }
+      else
+        {
+          valid = false;
+        }
+    }
+  if (!valid)
+    {
+      fprintf (stderr, USAGE_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Create the Zipf corpus of tokens_num tokens of the config, see
+ * create_corpus. Every corpus size is its own stream of config->seed.
+ * @param corpus the corpus to fill
+ * @param config the vocabulary size, skew and seed
+ * @param tokens_num number of tokens in the corpus
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int create_zipf_corpus (Corpus *corpus, const SuiteConfig *config,
+                               long tokens_num)
+{
+  Rng rng;
+  seed_rng (&rng, config->seed, (uint64_t) tokens_num);
+  return create_corpus (corpus, tokens_num, config->vocabulary_size,
+                        config->skew, &rng);
+}
+
+/**
+ * Write the corpus as text, a line per line of the corpus.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int write_corpus (const Corpus *corpus, const char *path)
+{
+  FILE *fp = fopen (path, "w");
+  if (!fp)
+    {
+      fprintf (stderr, FILE_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+  bool line_start = true;
+  for (long i = 0; i < corpus->length; ++i)
+    {
+      if (!corpus->tokens[i])
+        {
+          fputc ('\n', fp);
+          line_start = true;
+          continue;
+        }
+      fprintf (fp, line_start ? "%s" : " %s", corpus->tokens[i]);
+      line_start = false;
+    }
+  if (fclose (fp) != 0)
+    {
+      fprintf (stderr, FILE_ERR_MSG);
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Time every operation on a chain of the corpus, each on its own so that
+ * their costs don't mix: add_to_database of every token, then
+ * add_node_to_counter_list of every pair of successive tokens,
+ * get_next_random_node along random walks, generate_random_sequence (to
+ * /dev/null) before and after freezing the chain, freezing it,
+ * free_markov_chain, ingesting into a ConcurrentChain if
+ * config->producers is set, and generating out of snapshots while
+ * ingesting if config->snapshots is. Prints the run as JSON.
+ * @param corpus the corpus to build the chain of
+ * @param config the config of the suite
+ * @param last whether this is the last run
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int run_suite (const Corpus *corpus, const SuiteConfig *config,
+                      bool last)
+{
+  MarkovChain *markov_chain = create_word_chain ();
+  MarkovNode **nodes = malloc ((size_t) corpus->length
+                               * sizeof (MarkovNode *));
+  if (!markov_chain || !nodes)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (nodes);
+      free_markov_chain (&markov_chain);
+      return EXIT_FAILURE;
+    }
+  Measurement measurements[MAX_MEASUREMENTS] = {
+      {"add_to_database", corpus->tokens_num, 0},
+      {"add_node_to_counter_list", 0, 0},
+      {"get_next_random_node", 0, 0},
+      {"generate_random_sequence", 0, 0},
+      {"freeze_markov_chain", 1, 0},
+      {"generate_random_sequence_frozen", 0, 0},
+      {"free_markov_chain", 1, 0},
+  };
+  int measurements_num = BASE_MEASUREMENTS;
+
+  double start = get_time ();
+  for (long i = 0; i < corpus->length; ++i)
+    {
+      Node *node = corpus->tokens[i]
+                   ? add_to_database (markov_chain, corpus->tokens[i])
+                   : NULL;
+      if (corpus->tokens[i] && !node)
+        {
+          free (nodes);
+          return EXIT_FAILURE;
+        }
+      nodes[i] = node ? node->data : NULL;
+    }
+  measurements[0].seconds = get_time () - start;
+
+  start = get_time ();
+  for (long i = 1; i < corpus->length; ++i)
+    {
+      if (!nodes[i - 1] || !nodes[i])
+        {
+          continue;
+        }
+      measurements[1].operations++;
+      if (!add_node_to_counter_list (nodes[i - 1], nodes[i], markov_chain))
+        {
+          free (nodes);
+          free_markov_chain (&markov_chain);
+          return EXIT_FAILURE;
+        }
+    }
+  measurements[1].seconds = get_time () - start;
+  free (nodes);
+
+  Rng rng;
+  seed_rng (&rng, config->seed, 0);
+  long steps = (long) (corpus->tokens_num * NEXT_NODE_STEPS_PER_TOKEN);
+  start = get_time ();
+  MarkovNode *node = get_first_random_node (markov_chain, &rng);
+  for (long i = 0; i < steps; ++i)
+    {
+      node = node->is_last || !node->counter_list
+             ? get_first_random_node (markov_chain, &rng)
+             : get_next_random_node (node, &rng);
+    }
+  measurements[2].operations = steps;
+  measurements[2].seconds = get_time () - start;
+
+  // the sequences are printed, so print them to /dev/null
+  long sequences = (long) (corpus->tokens_num * SEQUENCES_PER_TOKEN) + 1;
+  fflush (stdout);
+  int stdout_fd = dup (STDOUT_FILENO);
+  int null_fd = open ("/dev/null", O_WRONLY);
+  if (stdout_fd < 0 || null_fd < 0 || dup2 (null_fd, STDOUT_FILENO) < 0)
+    {
+      fprintf (stderr, FILE_ERR_MSG);
+      if (stdout_fd >= 0)
+        {
+          close (stdout_fd);
+        }
+      if (null_fd >= 0)
+        {
+          close (null_fd);
+        }
+      free_markov_chain (&markov_chain);
+      return EXIT_FAILURE;
+    }
+  bool froze = true;
+  for (int frozen = 0; frozen < 2; ++frozen)
+    {
+      Measurement *measurement = &measurements[frozen ? 5 : 3];
+      if (frozen)
+        {
+          start = get_time ();
+          froze = freeze_markov_chain (markov_chain);
+          measurements[4].seconds = get_time () - start;
+          if (!froze)
+            {
+              break;
+            }
+        }
+      start = get_time ();
+      for (long i = 0; i < sequences; ++i)
+        {
+          generate_random_sequence (markov_chain, NULL, MAX_SEQUENCE_LENGTH,
+                                    &rng);
+        }
+      fflush (stdout);
+      measurement->operations = sequences;
+      measurement->seconds = get_time () - start;
+    }
+  bool restored = dup2 (stdout_fd, STDOUT_FILENO) >= 0;
+  close (stdout_fd);
+  close (null_fd);
+  if (!froze || !restored)
+    {
+      // the error of freeze_markov_chain went to /dev/null
+      fprintf (stderr, froze ? FILE_ERR_MSG : ALLOCATION_ERROR_MASSAGE);
+      free_markov_chain (&markov_chain);
+      return EXIT_FAILURE;
+    }
+
+  int states = markov_chain->database->size;
+  start = get_time ();
+  free_markov_chain (&markov_chain);
+  measurements[6].seconds = get_time () - start;
+  if (config->producers
+      && measure_concurrent_ingest (corpus, config,
+                                    &measurements[measurements_num++])
+         != EXIT_SUCCESS)
+    {
+      return EXIT_FAILURE;
+    }
+  if (config->snapshots
+      && measure_snapshots (corpus, config,
+                            &measurements[measurements_num]) != EXIT_SUCCESS)
+    {
+      return EXIT_FAILURE;
+    }
+  measurements_num += config->snapshots ? 3 : 0;
+  printf ("{\"tokens\": %ld, \"states\": %d, \"results\": [\n",
+          corpus->tokens_num, states);
+  for (int i = 0; i < measurements_num; ++i)
+    {
+      print_measurement (&measurements[i], i == measurements_num - 1);
+    }
+  printf ("]}%s\n", last ? "" : ",");
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Add a range of the corpus to the shared chain, counting the transitions
+ * within its lines (a thread's routine).
+ * @param arg the Producer
+ * @return NULL
+ */
+static void *produce (void *arg)
+{
+  Producer *producer = arg;
+  ConcurrentState *prev = NULL;
+  for (long i = producer->begin; i < producer->end; ++i)
+    {
+      char *token = producer->corpus->tokens[i];
+      ConcurrentState *curr = token
+                              ? add_to_concurrent_chain (
+                                  producer->concurrent_chain, token)
+                              : NULL;
+      if ((token && !curr)
+          || (prev && curr && !count_concurrent_transition (prev, curr)))
+        {
+          producer->success = false;
+          return NULL;
+        }
+      prev = curr;
+    }
+  return NULL;
+}
+
+/**
+ * Time config->producers threads adding the corpus to a single
+ * ConcurrentChain, each its own contiguous range of tokens (the
+ * transitions across the ranges are lost), states and transitions
+ * together.
+ * @param corpus the corpus to add
+ * @param config the config of the suite, with the number of threads
+ * @param measurement where to put the time
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int measure_concurrent_ingest (const Corpus *corpus,
+                                      const SuiteConfig *config,
+                                      Measurement *measurement)
+{
+  int producers = config->producers;
+  // a plain and a sentence-ending variant of every word
+  ConcurrentChain *concurrent_chain = create_concurrent_chain (
+      (size_t) config->vocabulary_size * 2);
+  if (!concurrent_chain)
+    {
+      return EXIT_FAILURE;
+    }
+  concurrent_chain->comp_func = compare_words;
+  concurrent_chain->copy_func = copy_word;
+  concurrent_chain->free_data = free_word;
+  concurrent_chain->is_last = is_last_word;
+  concurrent_chain->hash_func = hash_word;
+  Producer producer_ranges[MAX_PRODUCERS];
+  pthread_t threads[MAX_PRODUCERS];
+  for (int i = 0; i < producers; ++i)
+    {
+      producer_ranges[i] = (Producer) {corpus,
+                                       corpus->length * i / producers,
+                                       corpus->length * (i + 1) / producers,
+                                       concurrent_chain, true};
+    }
+
+  double start = get_time ();
+  int started = 0;
+  for (; started < producers; ++started)
+    {
+      if (pthread_create (&threads[started], NULL, produce,
+                          &producer_ranges[started]) != 0)
+        {
+          break;
+        }
+    }
+  // ranges that didn't get a thread run here
+  for (int i = started; i < producers; ++i)
+    {
+      produce (&producer_ranges[i]);
+    }
+  bool success = true;
+  for (int i = 0; i < producers; ++i)
+    {
+      if (i < started)
+        {
+          pthread_join (threads[i], NULL);
+        }
+      success = success && producer_ranges[i].success;
+    }
+  *measurement = (Measurement) {"concurrent_ingest", corpus->tokens_num,
+                                get_time () - start};
+  free_concurrent_chain (&concurrent_chain);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Generate sequences out of the current snapshots, without printing them
+ * (a thread's routine).
+ * @param arg the SnapshotGenerator
+ * @return NULL
+ */
+static void *generate_from_snapshots (void *arg)
+{
+  SnapshotGenerator *generator = arg;
+  uint32_t states[MAX_SEQUENCE_LENGTH];
+  double start = get_thread_time ();
+  generator->sequences = 0;
+  while (generator->sequences != generator->max_sequences
+         && !__atomic_load_n (&generator->stop, __ATOMIC_ACQUIRE))
+    {
+      const FrozenChain *frozen_chain = enter_snapshot (
+          generator->snapshot_chain, generator->reader);
+      uint32_t first = get_first_frozen_state (frozen_chain,
+                                               &generator->rng);
+      walk_frozen_chain (frozen_chain, first, MAX_SEQUENCE_LENGTH,
+                         &generator->rng, states);
+      leave_snapshot (generator->reader);
+      generator->sequences++;
+    }
+  generator->seconds = get_thread_time () - start;
+  return NULL;
+}
+
+/**
+ * Time generation out of the snapshots of a SnapshotChain, on its own
+ * thread, while the corpus is added to the chain in config->snapshots
+ * batches, each one published as a snapshot. Then time generating as many
+ * sequences again with nothing being added, out of the full chain: the
+ * sequences generated meanwhile shouldn't take longer, since readers
+ * never wait for the writer.
+ * The generation is timed by the CPU time of its thread, so that it
+ * doesn't count the time the thread waits for a CPU.
+ * @param corpus the corpus to add
+ * @param config the config of the suite
+ * @param measurements where to put the time of publishing, of generating
+ *        while adding, and of generating after
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int measure_snapshots (const Corpus *corpus, const SuiteConfig *config,
+                              Measurement *measurements)
+{
+  MarkovChain *markov_chain = create_word_chain ();
+  SnapshotChain *snapshot_chain = markov_chain
+                                  ? create_snapshot_chain (markov_chain)
+                                  : NULL;
+  SnapshotGenerator generator = {snapshot_chain, NULL, {{0}}, -1, false, 0,
+                                 0};
+  seed_rng (&generator.rng, config->seed, SNAPSHOT_STREAM);
+  if (snapshot_chain)
+    {
+      generator.reader = register_snapshot_reader (snapshot_chain);
+    }
+  pthread_t thread;
+  if (!generator.reader
+      || pthread_create (&thread, NULL, generate_from_snapshots,
+                         &generator) != 0)
+    {
+      if (snapshot_chain)
+        {
+          free_snapshot_chain (&snapshot_chain);
+        }
+      else if (markov_chain)
+        {
+          free_markov_chain (&markov_chain);
+        }
+      return EXIT_FAILURE;
+    }
+
+  bool success = true;
+  double publish_seconds = 0;
+  MarkovNode *prev = NULL;
+  long i = 0;
+  for (int batch = 0; success && batch < config->snapshots; ++batch)
+    {
+      long end = corpus->length * (batch + 1) / config->snapshots;
+      for (; success && i < end; ++i)
+        {
+          Node *node = corpus->tokens[i]
+                       ? add_to_database (markov_chain, corpus->tokens[i])
+                       : NULL;
+          if (corpus->tokens[i] && !node)
+            {
+              // add_to_database already freed markov_chain
+              snapshot_chain->markov_chain = NULL;
+              success = false;
+            }
+          else if (prev && node
+                   && !add_node_to_counter_list (prev, node->data,
+                                                 markov_chain))
+            {
+              success = false;
+            }
+          prev = node ? node->data : NULL;
+        }
+      double start = get_time ();
+      success = success && publish_snapshot (snapshot_chain);
+      publish_seconds += get_time () - start;
+    }
+  __atomic_store_n (&generator.stop, true, __ATOMIC_RELEASE);
+  pthread_join (thread, NULL);
+  measurements[0] = (Measurement) {"snapshot_publish", config->snapshots,
+                                   publish_seconds};
+  measurements[1] = (Measurement) {"snapshot_generate_during_ingest",
+                                   generator.sequences, generator.seconds};
+
+  generator.max_sequences = generator.sequences;
+  generator.stop = false;
+  generate_from_snapshots (&generator);
+  measurements[2] = (Measurement) {"snapshot_generate_after_ingest",
+                                   generator.sequences, generator.seconds};
+  free_snapshot_chain (&snapshot_chain);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Print a measurement as a JSON object.
+ * @param measurement the measurement
+ * @param last whether it is the last in its list
+ */
+static void print_measurement (const Measurement *measurement, bool last)
+{
+  double ns_per_operation = measurement->operations
+                            ? measurement->seconds * NANOS_IN_SECOND
+                              / measurement->operations
+                            : 0;
+  printf ("  {\"name\": \"%s\", \"operations\": %ld, \"seconds\": %.6f, "
+          "\"ns_per_op\": %.1f}%s\n", measurement->name,
+          measurement->operations, measurement->seconds, ns_per_operation,
+          last ? "" : ",");
+}
+
+/**
+ * @return CPU time of the calling thread in seconds
+ */
+static double get_thread_time (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / NANOS_IN_SECOND;
+}
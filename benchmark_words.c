@@ -0,0 +1,143 @@
+#define _POSIX_C_SOURCE 199309L // For clock_gettime()
+
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "benchmark_words.h"
+
+#define FNV_OFFSET_BASIS 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+
+int create_corpus (Corpus *corpus, long tokens_num, int vocabulary_size,
+                   double skew, Rng *rng)
+{
+  corpus->tokens_num = tokens_num;
+  corpus->length = tokens_num + tokens_num / WORDS_PER_LINE;
+  corpus->words = malloc ((size_t) vocabulary_size * 2 * WORD_LENGTH);
+  corpus->tokens = malloc ((size_t) corpus->length * sizeof (char *));
+  double *cumulative = malloc ((size_t) vocabulary_size * sizeof (double));
+  if (!corpus->words || !corpus->tokens || !cumulative)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (cumulative);
+      free_corpus (corpus);
+      *corpus = (Corpus) {NULL, NULL, 0, 0};
+      return EXIT_FAILURE;
+    }
+  double sum = 0;
+  for (int k = 0; k < vocabulary_size; ++k)
+    {
+      sum += pow (k + 1, -skew);
+      cumulative[k] = sum;
+      snprintf (corpus->words + (size_t) k * 2 * WORD_LENGTH, WORD_LENGTH,
+                "w%d", k);
+      snprintf (corpus->words + ((size_t) k * 2 + 1) * WORD_LENGTH,
+                WORD_LENGTH, "w%d.", k);
+    }
+
+  long j = 0;
+  for (long i = 0; i < tokens_num; ++i)
+    {
+      // draw uniformly in [0, sum), and find its word by binary search
+      double target = (double) (get_next_random (rng) >> RNG_BITS_IN_HALF)
+                      / ((double) UINT32_MAX + 1) * sum;
+      int low = 0;
+      int high = vocabulary_size - 1;
+      while (low < high)
+        {
+          int middle = low + (high - low) / 2;
+          if (cumulative[middle] <= target)
+            {
+              low = middle + 1;
+            }
+          else
+            {
+              high = middle;
+            }
+        }
+      int last = (i + 1) % WORDS_PER_LINE == 0;
+      corpus->tokens[j++] = corpus->words
+                            + ((size_t) low * 2 + last) * WORD_LENGTH;
+      if (last)
+        {
+          corpus->tokens[j++] = NULL;
+        }
+    }
+  corpus->length = j;
+  free (cumulative);
+  return EXIT_SUCCESS;
+}
+
+void free_corpus (Corpus *corpus)
+{
+  free (corpus->words);
+  free (corpus->tokens);
+}
+
+MarkovChain *create_word_chain (void)
+{
+  MarkovChain *markov_chain = create_markov_chain ();
+  if (!markov_chain)
+    {
+      return NULL;
+    }
+  markov_chain->print_func = print_word;
+  markov_chain->comp_func = compare_words;
+  markov_chain->free_data = free_word;
+  markov_chain->copy_func = copy_word;
+  markov_chain->is_last = is_last_word;
+  markov_chain->hash_func = hash_word;
+  return markov_chain;
+}
+
+double get_time (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / NANOS_IN_SECOND;
+}
+
+// functions for generic implementation
+void print_word (void *data)
+{
+  printf ("%s ", (char *) data);
+}
+
+int compare_words (void *ptr1, void *ptr2)
+{
+  return strcmp ((char *) ptr1, (char *) ptr2);
+}
+
+void free_word (void *data)
+{
+  free (data);
+}
+
+void *copy_word (void *ptr)
+{
+  size_t len = strlen ((char *) ptr) + 1;
+  void *dest = malloc (len);
+  if (!dest)
+    {
+      return NULL;
+    }
+  memcpy (dest, ptr, len);
+  return dest;
+}
+
+bool is_last_word (void *ptr)
+{
+  char *str = (char *) ptr;
+  return str[strlen (str) - 1] == '.';
+}
+
+// FNV-1a
+unsigned long hash_word (void *ptr)
+{
+  unsigned long hash = FNV_OFFSET_BASIS;
+  for (const unsigned char *c = ptr; *c; ++c)
+    {
+      hash = (hash ^ *c) * FNV_PRIME;
+    }
+  return hash;
+}
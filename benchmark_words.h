@@ -0,0 +1,63 @@
+#ifndef _BENCHMARK_WORDS_H_
+#define _BENCHMARK_WORDS_H_
+#include "markov_chain.h"
+
+#define WORDS_PER_LINE 15
+#define WORD_LENGTH 16
+#define NANOS_IN_SECOND 1e9
+
+/**
+ * A corpus to build chains from: tokens[i] is a word, or NULL at the end
+ * of a line. A word is only followed by the next one on the same line.
+ * The tokens point into words.
+ */
+typedef struct Corpus {
+    char *words;
+    char **tokens;
+    long length;
+    long tokens_num;
+} Corpus;
+
+/**
+ * Create a corpus of tokens_num tokens, where word k of the vocabulary (k
+ * from 1) is drawn with probability proportional to 1 / k^skew (so a skew
+ * of 0 draws them uniformly), in lines of WORDS_PER_LINE words. Every word
+ * has a plain and a sentence-ending ('.') variant, and the last word of
+ * every line is the latter.
+ * @param corpus the corpus to fill
+ * @param tokens_num number of tokens in the corpus
+ * @param vocabulary_size number of words in the vocabulary
+ * @param skew the exponent of the Zipf distribution
+ * @param rng the random number generator to draw the tokens from
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int create_corpus (Corpus *corpus, long tokens_num, int vocabulary_size,
+                   double skew, Rng *rng);
+
+/**
+ * Free the words and tokens of the corpus.
+ * @param corpus the corpus to free
+ */
+void free_corpus (Corpus *corpus);
+
+/**
+ * Creates an instance of Markov Chain of the words of a corpus, that
+ * copies every word it adds.
+ * @return a pointer to a MarkovChain, NULL if memory allocation failed.
+ */
+MarkovChain *create_word_chain (void);
+
+/**
+ * @return monotonic time in seconds
+ */
+double get_time (void);
+
+// functions for generic implementation, of words that are plain strings
+void print_word (void *data);
+int compare_words (void *ptr1, void *ptr2);
+void free_word (void *data);
+void *copy_word (void *ptr);
+bool is_last_word (void *ptr);
+unsigned long hash_word (void *ptr);
+
+#endif /* _BENCHMARK_WORDS_H_ */
@@ -0,0 +1,408 @@
+#include "concurrent_chain.h"
+#include "markov_stats.h"
+
+#define SUCCESSORS_INITIAL_CAPACITY 4
+#define SUCCESSOR_PROBE_LIMIT 4
+#define SUCCESSOR_TABLE_GROWTH 4
+#define SUCCESSOR_HASH_MULTIPLIER 2654435761u
+// counts above it may be incremented by enough threads at once to wrap
+// around, so they are incremented with compare and swap instead
+#define COUNT_SATURATION_MARGIN 65536
+
+/**
+ * Find the chunk of an id, and its position in the chunk.
+ * @param id the id of a state
+ * @param offset where to put the position in the chunk
+ * @return the index of the chunk
+ */
+static int find_state_chunk (uint32_t id, size_t *offset)
+{
+  size_t blocks = (size_t) id / STATE_CHUNK_SIZE + 1;
+  int chunk = 0;
+  while (blocks >> (chunk + 1))
+    {
+      ++chunk;
+    }
+  *offset = id - (size_t) STATE_CHUNK_SIZE * (((size_t) 1 << chunk) - 1);
+  return chunk;
+}
+
+ConcurrentChain *create_concurrent_chain (size_t expected_states)
+{
+  ConcurrentChain *concurrent_chain = calloc (1, sizeof (ConcurrentChain));
+  if (!concurrent_chain)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return NULL;
+    }
+  size_t buckets_num = 1;
+  while (buckets_num < expected_states)
+    {
+      buckets_num <<= 1;
+    }
+  concurrent_chain->buckets = calloc (buckets_num,
+                                      sizeof (ConcurrentState *));
+  if (!concurrent_chain->buckets)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (concurrent_chain);
+      return NULL;
+    }
+  COUNT_STAT (allocations, 2);
+  COUNT_STAT (bytes_allocated, sizeof (ConcurrentChain)
+                               + buckets_num * sizeof (ConcurrentState *));
+  concurrent_chain->buckets_num = buckets_num;
+  return concurrent_chain;
+}
+
+void free_concurrent_chain (ConcurrentChain **concurrent_chain)
+{
+  if (!concurrent_chain || !*concurrent_chain)
+    {
+      return;
+    }
+  ConcurrentChain *chain = *concurrent_chain;
+  for (size_t i = 0; i < chain->buckets_num; ++i)
+    {
+      ConcurrentState *state = chain->buckets[i];
+      while (state)
+        {
+          ConcurrentState *next = state->next;
+          SuccessorTable *table = state->successors;
+          while (table)
+            {
+              SuccessorTable *next_table = table->next;
+              free (table);
+              table = next_table;
+            }
+          chain->free_data (state->data);
+          free (state);
+          state = next;
+        }
+    }
+  for (int k = 0; k < STATE_CHUNKS_NUM; ++k)
+    {
+      free (chain->state_chunks[k]);
+    }
+  free (chain->buckets);
+  free (chain);
+  *concurrent_chain = NULL;
+}
+
+/**
+ * Look for data_ptr among the states from first up to (not including)
+ * last.
+ * @return the state of data_ptr, NULL if it is not there.
+ */
+static ConcurrentState *find_in_bucket (const ConcurrentChain
+                                        *concurrent_chain,
+                                        ConcurrentState *first,
+                                        const ConcurrentState *last,
+                                        void *data_ptr, unsigned long hash)
+{
+  for (ConcurrentState *state = first; state != last; state = state->next)
+    {
+      if (state->hash != hash)
+        {
+          continue;
+        }
+      COUNT_STAT (comparisons, 1);
+      if (concurrent_chain->comp_func (state->data, data_ptr) == 0)
+        {
+          return state;
+        }
+    }
+  return NULL;
+}
+
+/**
+ * Store a published state in its chunk, allocating the chunk if no other
+ * thread has yet.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool store_state (ConcurrentChain *concurrent_chain,
+                         ConcurrentState *state)
+{
+  size_t offset = 0;
+  int k = find_state_chunk (state->id, &offset);
+  ConcurrentState **chunk = __atomic_load_n (
+      &concurrent_chain->state_chunks[k], __ATOMIC_ACQUIRE);
+  if (!chunk)
+    {
+      size_t chunk_size = (size_t) STATE_CHUNK_SIZE << k;
+      ConcurrentState **new_chunk = calloc (chunk_size,
+                                            sizeof (ConcurrentState *));
+      if (!new_chunk)
+        {
+          return false;
+        }
+      COUNT_STAT (allocations, 1);
+      COUNT_STAT (bytes_allocated, chunk_size * sizeof (ConcurrentState *));
+      if (__atomic_compare_exchange_n (&concurrent_chain->state_chunks[k],
+                                       &chunk, new_chunk, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+          chunk = new_chunk;
+        }
+      else
+        {
+          // another thread allocated it first, and chunk is now its
+          free (new_chunk);
+        }
+    }
+  __atomic_store_n (&chunk[offset], state, __ATOMIC_RELEASE);
+  return true;
+}
+
+ConcurrentState *add_to_concurrent_chain (ConcurrentChain *concurrent_chain,
+                                          void *data_ptr)
+{
+  if (!data_ptr)
+    {
+      return NULL;
+    }
+  COUNT_STAT (lookups, 1);
+  unsigned long hash = concurrent_chain->hash_func (data_ptr);
+  ConcurrentState **bucket = concurrent_chain->buckets
+                             + (hash & (concurrent_chain->buckets_num - 1));
+  ConcurrentState *head = __atomic_load_n (bucket, __ATOMIC_ACQUIRE);
+  ConcurrentState *found = find_in_bucket (concurrent_chain, head, NULL,
+                                           data_ptr, hash);
+  if (found)
+    {
+      return found;
+    }
+
+  ConcurrentState *state = malloc (sizeof (ConcurrentState));
+  if (!state)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return NULL;
+    }
+  COUNT_STAT (allocations, 2);
+  COUNT_STAT (bytes_allocated, sizeof (ConcurrentState));
+  state->data = concurrent_chain->copy_func (data_ptr);
+  if (!state->data)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (state);
+      return NULL;
+    }
+  state->hash = hash;
+  state->is_last = concurrent_chain->is_last
+                   && concurrent_chain->is_last (state->data);
+  state->successors = NULL;
+  state->id = __atomic_fetch_add (&concurrent_chain->states_length, 1,
+                                  __ATOMIC_RELAXED);
+  state->next = head;
+  while (!__atomic_compare_exchange_n (bucket, &state->next, state, true,
+                                       __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+    {
+      // state->next is now the new head: only the states pushed since the
+      // last try may be the same state
+      found = find_in_bucket (concurrent_chain, state->next, head, data_ptr,
+                              hash);
+      if (found)
+        {
+          // it keeps its id, which is left unused
+          concurrent_chain->free_data (state->data);
+          free (state);
+          return found;
+        }
+      head = state->next;
+    }
+  if (!store_state (concurrent_chain, state))
+    {
+      // the state is in the chain, but can't be reached by its id
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return NULL;
+    }
+  return state;
+}
+
+ConcurrentState *get_concurrent_state (const ConcurrentChain
+                                       *concurrent_chain,
+                                       uint32_t id)
+{
+  size_t offset = 0;
+  int k = find_state_chunk (id, &offset);
+  ConcurrentState **chunk = __atomic_load_n (
+      &concurrent_chain->state_chunks[k], __ATOMIC_ACQUIRE);
+  return chunk ? __atomic_load_n (&chunk[offset], __ATOMIC_ACQUIRE) : NULL;
+}
+
+/**
+ * Allocate an empty successor table.
+ * @param capacity number of slots, a power of 2
+ * @return the table, NULL in case of allocation error.
+ */
+static SuccessorTable *create_successor_table (uint32_t capacity)
+{
+  SuccessorTable *table = calloc (1, sizeof (SuccessorTable)
+                                     + capacity * sizeof (ConcurrentCounter));
+  if (!table)
+    {
+      return NULL;
+    }
+  COUNT_STAT (allocations, 1);
+  COUNT_STAT (bytes_allocated, sizeof (SuccessorTable)
+                               + capacity * sizeof (ConcurrentCounter));
+  table->capacity = capacity;
+  return table;
+}
+
+/**
+ * Get the table that *link points to, linking a new one of capacity slots
+ * if no other thread has yet.
+ * @return the table, NULL in case of allocation error.
+ */
+static SuccessorTable *get_successor_table (SuccessorTable **link,
+                                            uint32_t capacity)
+{
+  SuccessorTable *table = __atomic_load_n (link, __ATOMIC_ACQUIRE);
+  if (table)
+    {
+      return table;
+    }
+  SuccessorTable *new_table = create_successor_table (capacity);
+  if (!new_table)
+    {
+      return NULL;
+    }
+  if (__atomic_compare_exchange_n (link, &table, new_table, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      return new_table;
+    }
+  free (new_table);
+  return table;
+}
+
+/**
+ * Increment a count by one, saturating at UINT32_MAX.
+ */
+static void increment_count (uint32_t *count)
+{
+  uint32_t current = __atomic_load_n (count, __ATOMIC_RELAXED);
+  if (current < UINT32_MAX - COUNT_SATURATION_MARGIN)
+    {
+      __atomic_fetch_add (count, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  while (current < UINT32_MAX
+         && !__atomic_compare_exchange_n (count, &current, current + 1, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+bool count_concurrent_transition (ConcurrentState *first_state,
+                                  ConcurrentState *second_state)
+{
+  uint32_t key = second_state->id + 1;
+  SuccessorTable **link = &first_state->successors;
+  uint32_t capacity = SUCCESSORS_INITIAL_CAPACITY;
+  while (true)
+    {
+      SuccessorTable *table = get_successor_table (link, capacity);
+      if (!table)
+        {
+          printf ("%s", ALLOCATION_ERROR_MASSAGE);
+          return false;
+        }
+      uint32_t mask = table->capacity - 1;
+      uint32_t slot = (key * SUCCESSOR_HASH_MULTIPLIER) & mask;
+      uint32_t probes = table->capacity < SUCCESSOR_PROBE_LIMIT
+                        ? table->capacity : SUCCESSOR_PROBE_LIMIT;
+      for (uint32_t i = 0; i < probes; ++i, slot = (slot + 1) & mask)
+        {
+          ConcurrentCounter *counter = table->slots + slot;
+          uint32_t current = __atomic_load_n (&counter->key,
+                                              __ATOMIC_ACQUIRE);
+          if (current == 0)
+            {
+              // on failure current becomes the key that took the slot
+              __atomic_compare_exchange_n (&counter->key, &current, key,
+                                           false, __ATOMIC_ACQ_REL,
+                                           __ATOMIC_ACQUIRE);
+              if (current == 0)
+                {
+                  current = key;
+                }
+            }
+          if (current == key)
+            {
+              increment_count (&counter->count);
+              return true;
+            }
+        }
+      link = &table->next;
+      capacity = table->capacity * SUCCESSOR_TABLE_GROWTH;
+    }
+}
+
+bool copy_concurrent_chain (const ConcurrentChain *concurrent_chain,
+                            MarkovChain *markov_chain)
+{
+  uint32_t length = __atomic_load_n (&concurrent_chain->states_length,
+                                     __ATOMIC_ACQUIRE);
+  Node **copied = calloc ((size_t) length + 1, sizeof (Node *));
+  if (!copied)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return false;
+    }
+  COUNT_STAT (allocations, 1);
+  COUNT_STAT (bytes_allocated, ((size_t) length + 1) * sizeof (Node *));
+  for (uint32_t id = 0; id < length; ++id)
+    {
+      ConcurrentState *state = get_concurrent_state (concurrent_chain, id);
+      if (!state)
+        {
+          // an unused id, or a state that is still being added
+          continue;
+        }
+      copied[id] = add_to_database (markov_chain, state->data);
+      if (!copied[id])
+        {
+          // add_to_database already freed markov_chain
+          free (copied);
+          return false;
+        }
+    }
+  for (uint32_t id = 0; id < length; ++id)
+    {
+      // a state stored after the loop above skipped it isn't copied
+      ConcurrentState *state = copied[id]
+                               ? get_concurrent_state (concurrent_chain, id)
+                               : NULL;
+      SuccessorTable *table = state ? __atomic_load_n (&state->successors,
+                                                       __ATOMIC_ACQUIRE)
+                                    : NULL;
+      for (; table; table = __atomic_load_n (&table->next, __ATOMIC_ACQUIRE))
+        {
+          for (uint32_t i = 0; i < table->capacity; ++i)
+            {
+              uint32_t key = __atomic_load_n (&table->slots[i].key,
+                                              __ATOMIC_ACQUIRE);
+              uint32_t count = __atomic_load_n (&table->slots[i].count,
+                                                __ATOMIC_RELAXED);
+              // skip the successors added after the copy started
+              if (key == 0 || key > length || !copied[key - 1] || count == 0)
+                {
+                  continue;
+                }
+              if (!add_counts_to_counter_list (copied[id]->data,
+                                               copied[key - 1]->data,
+                                               markov_chain, count))
+                {
+                  free (copied);
+                  return false;
+                }
+            }
+        }
+    }
+  free (copied);
+  return true;
+}
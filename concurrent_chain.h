@@ -0,0 +1,137 @@
+#ifndef _CONCURRENT_CHAIN_H_
+#define _CONCURRENT_CHAIN_H_
+#include "markov_chain.h"
+
+#define STATE_CHUNKS_NUM 32
+#define STATE_CHUNK_SIZE 1024
+
+/**
+ * A successor of a ConcurrentState: the id + 1 of the successor (0 while
+ * the slot is empty), set once, and the number of times the transition
+ * was counted, which only grows.
+ */
+typedef struct ConcurrentCounter {
+    uint32_t key;
+    uint32_t count;
+} ConcurrentCounter;
+
+/**
+ * An open addressing table of successors, by key. Tables never move or
+ * shrink: when the (short) probe sequence of a key is full, the key goes on
+ * to the next table, a few times as large, so a key is in exactly one
+ * table.
+ */
+typedef struct SuccessorTable {
+    struct SuccessorTable *next;
+    uint32_t capacity;
+    ConcurrentCounter slots[];
+} SuccessorTable;
+
+/**
+ * A state of a ConcurrentChain. Everything but successors is set before
+ * the state is published, and never changes.
+ */
+typedef struct ConcurrentState {
+    void *data;
+    unsigned long hash;
+    uint32_t id;
+    bool is_last;
+
+    // the next state in the same bucket
+    struct ConcurrentState *next;
+
+    // the first table of successors, NULL until the first transition
+    SuccessorTable *successors;
+} ConcurrentState;
+
+/**
+ * A chain that many threads may add states and count transitions to at
+ * the same time, without locks: states are pushed into the buckets of a
+ * hash table with compare and swap, transitions are counted with atomic
+ * increments, and successor tables grow by linking new ones, so readers
+ * are never blocked and never see memory go away. It is meant for
+ * ingestion: copy it into a MarkovChain to generate out of it.
+ * Create it with create_concurrent_chain and set the callbacks, like a
+ * MarkovChain's (hash_func is required), before sharing it.
+ */
+typedef struct ConcurrentChain {
+    ConcurrentState **buckets;
+    size_t buckets_num;
+
+    // the next id to give. Ids that lost a race to add the same state are
+    // never used, so states may have gaps in between.
+    uint32_t states_length;
+
+    // the states by id, in chunks that never move: chunk k holds
+    // STATE_CHUNK_SIZE << k states
+    ConcurrentState **state_chunks[STATE_CHUNKS_NUM];
+
+    comp_data comp_func;
+    copy_data copy_func;
+    hash_data hash_func;
+    is_last_data is_last;
+    free_data_data free_data;
+} ConcurrentChain;
+
+/**
+ * Allocate a new, empty ConcurrentChain.
+ * @param expected_states the number of states the chain is expected to
+ *        get, to size its hash table (more states make lookups slower)
+ * @return the chain, NULL in case of allocation error.
+ */
+ConcurrentChain *create_concurrent_chain (size_t expected_states);
+
+/**
+ * Free the chain and all of its content. No other thread may use it.
+ * @param concurrent_chain the chain to free
+ */
+void free_concurrent_chain (ConcurrentChain **concurrent_chain);
+
+/**
+ * Find the state of data_ptr, adding a copy of it if it is not in the
+ * chain yet. Safe to call from any number of threads at the same time: a
+ * state is added exactly once.
+ * @param concurrent_chain the chain
+ * @param data_ptr the state to look for
+ * @return the state, NULL in case of allocation error (the chain stays
+ * valid).
+ */
+ConcurrentState *add_to_concurrent_chain (ConcurrentChain *concurrent_chain,
+                                          void *data_ptr);
+
+/**
+ * Count a transition from first_state to second_state, with an atomic
+ * increment. Safe to call from any number of threads at the same time.
+ * A count saturates at UINT32_MAX.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+bool count_concurrent_transition (ConcurrentState *first_state,
+                                  ConcurrentState *second_state);
+
+/**
+ * Get the state of an id.
+ * @return the state, NULL if the id is not (or not yet) a state.
+ */
+ConcurrentState *get_concurrent_state (const ConcurrentChain
+                                       *concurrent_chain,
+                                       uint32_t id);
+
+/**
+ * Add the states and counts of concurrent_chain to markov_chain: the
+ * states in the order of their ids, and the counts of every state in no
+ * particular order. May run while other threads still add to
+ * concurrent_chain, in which case every count is copied as it was at some
+ * point during the copy.
+ * The data of the states is passed to add_to_database as data_ptr, so it
+ * must be a valid lookup key for markov_chain (see comp_func).
+ * @param concurrent_chain the chain to copy
+ * @param markov_chain the chain to add to
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error (markov_chain may be freed, like in
+ * add_to_database).
+ */
+bool copy_concurrent_chain (const ConcurrentChain *concurrent_chain,
+                            MarkovChain *markov_chain);
+
+#endif /* _CONCURRENT_CHAIN_H_ */
@@ -0,0 +1,669 @@
+#include "frozen_chain.h"
+#include <limits.h>   // For INT_MAX
+#include <fcntl.h>    // For open()
+#include <sys/mman.h> // For mmap()
+#include <sys/stat.h> // For fstat()
+#include <unistd.h>   // For close()
+
+#define ALIGNMENT 8
+#define MODEL_MAGIC "MRKVCHN"
+#define MODEL_VERSION 1
+
+/**
+ * Header of a model file. It is followed by the block of arrays of the
+ * FrozenChain, where the data array holds offsets into the payload table
+ * instead of pointers, and then by the payload table: the data of every
+ * state, each one aligned to ALIGNMENT.
+ */
+typedef struct ModelHeader {
+    char magic[sizeof (MODEL_MAGIC)];
+    uint32_t version;
+    uint32_t pointer_size;
+    uint32_t states_length;
+    uint32_t edges_length;
+    uint32_t start_states_length;
+    uint32_t reserved;
+    uint64_t block_size;
+    uint64_t payload_size;
+} ModelHeader;
+
+/**
+ * Round size up to a multiple of ALIGNMENT.
+ */
+static size_t align_size (size_t size)
+{
+  return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+/**
+ * Build the alias table of a single state with Vose's method. Each weight
+ * is scaled by the number of successors, so that a column is "full" when
+ * its scaled weight reaches the sum of weights and all the arithmetic
+ * stays exact.
+ * @param weights the state's weights
+ * @param len number of successors
+ * @param sum sum of weights
+ * @param table the state's alias table to fill
+ * @param scaled scratch space for len entries
+ * @param work scratch space for len entries
+ */
+static void build_alias_table (const uint32_t *weights, uint32_t len,
+                               uint32_t sum, AliasEntry *table,
+                               long long *scaled, uint32_t *work)
+{
+  long long full = sum;
+  // small indices are pushed from the start, large ones from the end
+  uint32_t small = 0, large = len;
+  for (uint32_t i = 0; i < len; ++i)
+    {
+      scaled[i] = (long long) weights[i] * len;
+      if (scaled[i] < full)
+        {
+          work[small++] = i;
+        }
+      else
+        {
+          work[--large] = i;
+        }
+    }
+  while (small > 0 && large < len)
+    {
+      uint32_t s = work[--small];
+      uint32_t l = work[large];
+      table[s] = (AliasEntry) {(int) scaled[s], (int) l};
+      scaled[l] -= full - scaled[s];
+      if (scaled[l] < full)
+        {
+          large++;
+          work[small++] = l;
+        }
+    }
+  // whatever is left is exactly full
+  while (small > 0)
+    {
+      uint32_t i = work[--small];
+      table[i] = (AliasEntry) {(int) full, (int) i};
+    }
+  while (large < len)
+    {
+      uint32_t i = work[large++];
+      table[i] = (AliasEntry) {(int) full, (int) i};
+    }
+}
+
+/**
+ * Point frozen_chain's arrays into the block of memory at base (if not
+ * NULL). states_length, edges_length and start_states_length must be set.
+ * The model file format stores the block as is, see save_frozen_chain.
+ * @return size of the block
+ */
+static size_t layout_frozen_chain (FrozenChain *frozen_chain, char *base)
+{
+  size_t states = frozen_chain->states_length;
+  size_t edges = frozen_chain->edges_length;
+  size_t sizes[] = {(states / LAST_STATES_WORD_BITS + 1) * sizeof (uint64_t),
+                    states * sizeof (void *),
+                    edges * sizeof (AliasEntry),
+                    (states + 1) * sizeof (uint32_t),
+                    edges * sizeof (uint32_t),
+                    edges * sizeof (uint32_t),
+                    states * sizeof (uint32_t),
+                    frozen_chain->start_states_length * sizeof (uint32_t)};
+  void **arrays[] = {(void **) &frozen_chain->last_states,
+                     (void **) &frozen_chain->data,
+                     (void **) &frozen_chain->alias_table,
+                     (void **) &frozen_chain->offsets,
+                     (void **) &frozen_chain->successors,
+                     (void **) &frozen_chain->weights,
+                     (void **) &frozen_chain->weight_sums,
+                     (void **) &frozen_chain->start_states};
+  size_t size = 0;
+  for (size_t i = 0; i < sizeof (sizes) / sizeof (sizes[0]); ++i)
+    {
+      if (base)
+        {
+          *arrays[i] = base + size;
+        }
+      size += align_size (sizes[i]);
+    }
+  return size;
+}
+
+/**
+ * Allocate frozen_chain's block of memory and point its arrays into it.
+ * states_length, edges_length and start_states_length must be set.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool allocate_frozen_chain (FrozenChain *frozen_chain)
+{
+  frozen_chain->memory_size = layout_frozen_chain (frozen_chain, NULL);
+  frozen_chain->memory = calloc (1, frozen_chain->memory_size);
+  if (!frozen_chain->memory)
+    {
+      return false;
+    }
+  layout_frozen_chain (frozen_chain, frozen_chain->memory);
+  return true;
+}
+
+/**
+ * Copy the states and counter lists of markov_chain into the CSR arrays
+ * of frozen_chain.
+ * @return the largest number of successors of a single state
+ */
+static uint32_t fill_frozen_chain (FrozenChain *frozen_chain,
+                                   MarkovChain *markov_chain)
+{
+  uint32_t max_length = 0, edge = 0;
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      MarkovNode *markov_node = markov_chain->states[i]->data;
+      frozen_chain->data[i] = markov_node->data;
+      if (markov_node->is_last)
+        {
+          frozen_chain->last_states[i / LAST_STATES_WORD_BITS]
+              |= (uint64_t) 1 << (i % LAST_STATES_WORD_BITS);
+        }
+      frozen_chain->offsets[i] = edge;
+      // the coins of the alias table are ints, so frequencies whose sum
+      // doesn't fit in one are scaled down (keeping every one positive)
+      int shift = 0;
+      while ((markov_node->counter_list_sum >> shift)
+             + markov_node->counter_list_length > INT_MAX)
+        {
+          shift++;
+        }
+      uint32_t sum = 0;
+      for (int j = 0; j < markov_node->counter_list_length; ++j, ++edge)
+        {
+          NextNodeCounter *counter = markov_node->counter_list + j;
+          uint32_t weight = counter->frequency >> shift;
+          frozen_chain->successors[edge] = counter->id;
+          frozen_chain->weights[edge] = weight ? weight : 1;
+          sum += frozen_chain->weights[edge];
+        }
+      frozen_chain->weight_sums[i] = sum;
+      if ((uint32_t) markov_node->counter_list_length > max_length)
+        {
+          max_length = markov_node->counter_list_length;
+        }
+    }
+  frozen_chain->offsets[frozen_chain->states_length] = edge;
+  for (uint32_t i = 0; i < frozen_chain->start_states_length; ++i)
+    {
+      frozen_chain->start_states[i] = markov_chain->start_states[i]->id;
+    }
+  return max_length;
+}
+
+FrozenChain *create_frozen_chain (MarkovChain *markov_chain)
+{
+  FrozenChain *frozen_chain = calloc (1, sizeof (FrozenChain));
+  if (!frozen_chain)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return NULL;
+    }
+  frozen_chain->states_length = markov_chain->database->size;
+  frozen_chain->start_states_length = markov_chain->start_states_length;
+  for (int i = 0; i < markov_chain->database->size; ++i)
+    {
+      frozen_chain->edges_length
+          += markov_chain->states[i]->data->counter_list_length;
+    }
+  if (!allocate_frozen_chain (frozen_chain))
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (frozen_chain);
+      return NULL;
+    }
+
+  uint32_t max_length = fill_frozen_chain (frozen_chain, markov_chain);
+  long long *scaled = malloc ((max_length + 1) * sizeof (long long));
+  uint32_t *work = malloc ((max_length + 1) * sizeof (uint32_t));
+  if (!scaled || !work)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (scaled);
+      free (work);
+      free_frozen_chain (&frozen_chain);
+      return NULL;
+    }
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      uint32_t offset = frozen_chain->offsets[i];
+      build_alias_table (frozen_chain->weights + offset,
+                         frozen_chain->offsets[i + 1] - offset,
+                         frozen_chain->weight_sums[i],
+                         frozen_chain->alias_table + offset, scaled, work);
+    }
+  free (scaled);
+  free (work);
+  return frozen_chain;
+}
+
+void free_frozen_chain (FrozenChain **frozen_chain)
+{
+  if (!*frozen_chain)
+    {
+      return;
+    }
+  if ((*frozen_chain)->mapped)
+    {
+      munmap ((*frozen_chain)->memory, (*frozen_chain)->memory_size);
+    }
+  else
+    {
+      free ((*frozen_chain)->memory);
+    }
+  free ((*frozen_chain)->tokens);
+  free ((*frozen_chain)->token_offsets);
+  free (*frozen_chain);
+  *frozen_chain = NULL;
+}
+
+uint32_t get_first_frozen_state (const FrozenChain *frozen_chain, Rng *rng)
+{
+  if (frozen_chain->start_states_length == 0)
+    {
+      return frozen_chain->states_length;
+    }
+  int rand = get_random_number (rng,
+                                (int) frozen_chain->start_states_length);
+  return frozen_chain->start_states[rand];
+}
+
+uint32_t get_next_frozen_state (const FrozenChain *frozen_chain,
+                                uint32_t state,
+                                Rng *rng)
+{
+  uint32_t offset = frozen_chain->offsets[state];
+  int length = (int) (frozen_chain->offsets[state + 1] - offset);
+  int column = get_random_number (rng, length);
+  int coin = get_random_number (rng,
+                                (int) frozen_chain->weight_sums[state]);
+  const AliasEntry *entry = frozen_chain->alias_table + offset + column;
+  if (coin >= entry->threshold)
+    {
+      column = entry->alias;
+    }
+  return frozen_chain->successors[offset + column];
+}
+
+void generate_frozen_sequence (const FrozenChain *frozen_chain,
+                               print_data print_func,
+                               uint32_t first_state,
+                               int max_length,
+                               Rng *rng)
+{
+  uint32_t next = first_state;
+  if (next >= frozen_chain->states_length)
+    {
+      printf ("\n");
+      return;
+    }
+  print_func (frozen_chain->data[next]);
+  max_length--;
+  do
+    {
+      if (frozen_chain->offsets[next] == frozen_chain->offsets[next + 1])
+        {
+          break;
+        }
+      next = get_next_frozen_state (frozen_chain, next, rng);
+      print_func (frozen_chain->data[next]);
+    }
+  while (--max_length > 0 && !is_last_frozen_state (frozen_chain, next));
+  printf ("\n");
+}
+
+int walk_frozen_chain (const FrozenChain *frozen_chain,
+                       uint32_t first_state,
+                       int max_length,
+                       Rng *rng,
+                       uint32_t *states)
+{
+  uint32_t next = first_state;
+  if (next >= frozen_chain->states_length)
+    {
+      return 0;
+    }
+  int length = 0;
+  states[length++] = next;
+  max_length--;
+  do
+    {
+      if (frozen_chain->offsets[next] == frozen_chain->offsets[next + 1])
+        {
+          break;
+        }
+      next = get_next_frozen_state (frozen_chain, next, rng);
+      states[length++] = next;
+    }
+  while (--max_length > 0 && !is_last_frozen_state (frozen_chain, next));
+  return length;
+}
+
+bool format_frozen_tokens (FrozenChain *frozen_chain,
+                           format_data format_func)
+{
+  uint32_t *offsets = malloc ((frozen_chain->states_length + 1)
+                              * sizeof (uint32_t));
+  if (!offsets)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return false;
+    }
+  size_t total = 0;
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      offsets[i] = (uint32_t) total;
+      total += format_func (frozen_chain->data[i], NULL, 0);
+    }
+  offsets[frozen_chain->states_length] = (uint32_t) total;
+  char *tokens = total <= UINT32_MAX ? malloc (total + 1) : NULL;
+  if (!tokens)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (offsets);
+      return false;
+    }
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      format_func (frozen_chain->data[i], tokens + offsets[i],
+                   offsets[i + 1] - offsets[i]);
+    }
+  free (frozen_chain->tokens);
+  free (frozen_chain->token_offsets);
+  frozen_chain->tokens = tokens;
+  frozen_chain->token_offsets = offsets;
+  return true;
+}
+
+/**
+ * Append the cached text of a single state to buffer.
+ */
+static bool write_frozen_state (const FrozenChain *frozen_chain,
+                                uint32_t state,
+                                OutputBuffer *buffer)
+{
+  uint32_t offset = frozen_chain->token_offsets[state];
+  return append_to_output (buffer, frozen_chain->tokens + offset,
+                           frozen_chain->token_offsets[state + 1] - offset);
+}
+
+bool write_frozen_states (const FrozenChain *frozen_chain,
+                          const uint32_t *states,
+                          int length,
+                          OutputBuffer *buffer)
+{
+  bool success = true;
+  for (int i = 0; i < length; ++i)
+    {
+      success = write_frozen_state (frozen_chain, states[i], buffer)
+                && success;
+    }
+  return append_to_output (buffer, "\n", 1) && success;
+}
+
+bool write_frozen_sequence (const FrozenChain *frozen_chain,
+                            uint32_t first_state,
+                            int max_length,
+                            Rng *rng,
+                            OutputBuffer *buffer)
+{
+  uint32_t next = first_state;
+  if (next >= frozen_chain->states_length)
+    {
+      return append_to_output (buffer, "\n", 1);
+    }
+  bool success = write_frozen_state (frozen_chain, next, buffer);
+  max_length--;
+  do
+    {
+      if (frozen_chain->offsets[next] == frozen_chain->offsets[next + 1])
+        {
+          break;
+        }
+      next = get_next_frozen_state (frozen_chain, next, rng);
+      success = write_frozen_state (frozen_chain, next, buffer) && success;
+    }
+  while (--max_length > 0 && !is_last_frozen_state (frozen_chain, next));
+  return append_to_output (buffer, "\n", 1) && success;
+}
+
+/**
+ * Write size bytes from ptr to fp, padded with zeros to ALIGNMENT.
+ * @return success/failure: true if the process was successful, false in
+ * case of an IO error.
+ */
+static bool write_aligned (FILE *fp, const void *ptr, size_t size)
+{
+  static const char padding[ALIGNMENT] = {0};
+  size_t padding_size = align_size (size) - size;
+  return fwrite (ptr, 1, size, fp) == size
+         && fwrite (padding, 1, padding_size, fp) == padding_size;
+}
+
+bool save_frozen_chain (const FrozenChain *frozen_chain,
+                        size_data size_func,
+                        const char *path)
+{
+  FILE *fp = fopen (path, "wb");
+  if (!fp)
+    {
+      fprintf (stderr, MODEL_ERROR_MASSAGE);
+      return false;
+    }
+  ModelHeader header = {MODEL_MAGIC, MODEL_VERSION, sizeof (void *),
+                        frozen_chain->states_length,
+                        frozen_chain->edges_length,
+                        frozen_chain->start_states_length, 0,
+                        frozen_chain->memory_size, 0};
+  uint64_t *payload_offsets = malloc ((frozen_chain->states_length + 1)
+                                      * sizeof (uint64_t));
+  if (!payload_offsets)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      fclose (fp);
+      return false;
+    }
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      payload_offsets[i] = header.payload_size;
+      header.payload_size += align_size (size_func (frozen_chain->data[i]));
+    }
+
+  // the data array sits between last_states and alias_table in the block
+  const char *block = frozen_chain->memory;
+  size_t before_data = (char *) frozen_chain->data - block;
+  size_t after_data = (char *) frozen_chain->alias_table - block;
+  bool success = write_aligned (fp, &header, sizeof (header))
+                 && write_aligned (fp, block, before_data)
+                 && write_aligned (fp, payload_offsets,
+                                   after_data - before_data)
+                 && write_aligned (fp, block + after_data,
+                                   frozen_chain->memory_size - after_data);
+  for (uint32_t i = 0; success && i < frozen_chain->states_length; ++i)
+    {
+      success = write_aligned (fp, frozen_chain->data[i],
+                               size_func (frozen_chain->data[i]));
+    }
+  free (payload_offsets);
+  if (fclose (fp) != 0 || !success)
+    {
+      fprintf (stderr, MODEL_ERROR_MASSAGE);
+      return false;
+    }
+  return true;
+}
+
+/**
+ * Check that the header read from a model file of file_size bytes
+ * matches this build and the size of the file.
+ */
+static bool validate_header (const ModelHeader *header, size_t file_size)
+{
+  if (memcmp (header->magic, MODEL_MAGIC, sizeof (MODEL_MAGIC)) != 0
+      || header->version != MODEL_VERSION
+      || header->pointer_size != sizeof (void *))
+    {
+      return false;
+    }
+  FrozenChain sizes = {0};
+  sizes.states_length = header->states_length;
+  sizes.edges_length = header->edges_length;
+  sizes.start_states_length = header->start_states_length;
+  return header->block_size == layout_frozen_chain (&sizes, NULL)
+         && align_size (sizeof (ModelHeader)) + header->block_size
+            + header->payload_size == file_size;
+}
+
+/**
+ * Check that the arrays of a loaded frozen_chain describe a valid chain:
+ * the offsets grow up to edges_length, every id is a state, and the alias
+ * table of every state with successors matches its weights.
+ */
+static bool validate_arrays (const FrozenChain *frozen_chain)
+{
+  uint32_t states = frozen_chain->states_length;
+  if (frozen_chain->offsets[0] != 0
+      || frozen_chain->offsets[states] != frozen_chain->edges_length)
+    {
+      return false;
+    }
+  // the offsets are all checked before any edge is read by them
+  for (uint32_t i = 0; i < states; ++i)
+    {
+      if (frozen_chain->offsets[i + 1] < frozen_chain->offsets[i])
+        {
+          return false;
+        }
+    }
+  for (uint32_t i = 0; i < states; ++i)
+    {
+      uint32_t offset = frozen_chain->offsets[i];
+      uint32_t next_offset = frozen_chain->offsets[i + 1];
+      uint64_t sum = 0;
+      for (uint32_t edge = offset; edge < next_offset; ++edge)
+        {
+          if (frozen_chain->successors[edge] >= states
+              || frozen_chain->weights[edge] == 0)
+            {
+              return false;
+            }
+          sum += frozen_chain->weights[edge];
+        }
+      if (sum != frozen_chain->weight_sums[i]
+          || (offset < next_offset && (sum == 0 || sum > INT_MAX)))
+        {
+          return false;
+        }
+      for (uint32_t edge = offset; edge < next_offset; ++edge)
+        {
+          AliasEntry entry = frozen_chain->alias_table[edge];
+          if (entry.threshold < 0 || (uint64_t) entry.threshold > sum
+              || entry.alias < 0
+              || (uint32_t) entry.alias >= next_offset - offset)
+            {
+              return false;
+            }
+        }
+    }
+  for (uint32_t i = 0; i < frozen_chain->start_states_length; ++i)
+    {
+      if (frozen_chain->start_states[i] >= states)
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+/**
+ * Turn the offsets of the data array of a loaded frozen_chain into
+ * pointers into payload. save_frozen_chain writes the data of the states
+ * in order, so the data of every state must start, aligned, where the one
+ * before it ends, and check_func (if not NULL) gets the whole room it
+ * takes up to the next one.
+ */
+static bool validate_data (FrozenChain *frozen_chain, char *payload,
+                           uint64_t payload_size, check_data check_func)
+{
+  uint64_t *offsets = (uint64_t *) frozen_chain->data;
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      uint64_t end = i + 1 < frozen_chain->states_length ? offsets[i + 1]
+                                                          : payload_size;
+      if (offsets[i] % ALIGNMENT != 0 || offsets[i] >= end
+          || end > payload_size)
+        {
+          return false;
+        }
+      if (check_func && !check_func (payload + offsets[i], end - offsets[i]))
+        {
+          return false;
+        }
+    }
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      frozen_chain->data[i] = payload + offsets[i];
+    }
+  return true;
+}
+
+FrozenChain *load_frozen_chain (const char *path, check_data check_func)
+{
+  int fd = open (path, O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat (fd, &file_stat) != 0
+      || (size_t) file_stat.st_size < sizeof (ModelHeader))
+    {
+      fprintf (stderr, MODEL_ERROR_MASSAGE);
+      if (fd >= 0)
+        {
+          close (fd);
+        }
+      return NULL;
+    }
+  size_t file_size = file_stat.st_size;
+  // private and writable, so that only the pages of the data array, that
+  // get their offsets turned into pointers, are copied
+  char *map = mmap (NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    {
+      fprintf (stderr, MODEL_ERROR_MASSAGE);
+      return NULL;
+    }
+  const ModelHeader *header = (const ModelHeader *) map;
+  FrozenChain *frozen_chain = calloc (1, sizeof (FrozenChain));
+  if (!validate_header (header, file_size) || !frozen_chain)
+    {
+      fprintf (stderr, frozen_chain ? MODEL_ERROR_MASSAGE
+                                    : ALLOCATION_ERROR_MASSAGE);
+      free (frozen_chain);
+      munmap (map, file_size);
+      return NULL;
+    }
+
+  frozen_chain->states_length = header->states_length;
+  frozen_chain->edges_length = header->edges_length;
+  frozen_chain->start_states_length = header->start_states_length;
+  frozen_chain->memory = map;
+  frozen_chain->memory_size = file_size;
+  frozen_chain->mapped = true;
+  char *block = map + align_size (sizeof (ModelHeader));
+  layout_frozen_chain (frozen_chain, block);
+  if (!validate_arrays (frozen_chain)
+      || !validate_data (frozen_chain, block + header->block_size,
+                         header->payload_size, check_func))
+    {
+      fprintf (stderr, MODEL_ERROR_MASSAGE);
+      free_frozen_chain (&frozen_chain);
+      return NULL;
+    }
+  return frozen_chain;
+}
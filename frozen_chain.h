@@ -0,0 +1,213 @@
+#ifndef _FROZEN_CHAIN_H
+#define _FROZEN_CHAIN_H
+
+#include <stdint.h>
+#include "markov_chain.h"
+
+#define LAST_STATES_WORD_BITS 64
+#define MODEL_ERROR_MASSAGE "ERROR: Failed to read or write the model file.\n"
+
+// pointer to a func that gets a pointer of generic data type and returns
+// the number of bytes it takes (a copy of which is a valid copy of it).
+typedef size_t (*size_data)(void*);
+
+// pointer to a func that gets a pointer to the raw bytes of generic data
+// type read from a model file, and the number of bytes they may take, and
+// returns whether they are a valid copy of it (without reading past them).
+typedef bool (*check_data)(const void*, size_t);
+
+/**
+ * A read-only, compressed sparse row (CSR) copy of a MarkovChain's graph.
+ * States are referred to by their 32-bit id (MarkovNode->id). The
+ * successors of state i are successors[offsets[i]] to
+ * successors[offsets[i + 1] - 1], with their frequencies at the same
+ * positions in weights and their alias table at the same positions in
+ * alias_table (alias indices are relative to offsets[i]).
+ * All the arrays live in a single block of memory.
+ */
+typedef struct FrozenChain {
+    uint32_t states_length;
+    uint32_t edges_length;
+    uint32_t start_states_length;
+
+    // states_length + 1 entries
+    uint32_t *offsets;
+
+    // edges_length entries each
+    uint32_t *successors;
+    uint32_t *weights;
+    AliasEntry *alias_table;
+
+    // sum of weights of every state
+    uint32_t *weight_sums;
+
+    // bit i is set iff state i is a last state
+    uint64_t *last_states;
+
+    // ids of the states that are not last states
+    uint32_t *start_states;
+
+    // the data of every state, owned by the MarkovChain it was made from
+    // (or by the mapped model file)
+    void **data;
+
+    // the text of every state, NULL until format_frozen_tokens: the text
+    // of state i is tokens[token_offsets[i]] to
+    // tokens[token_offsets[i + 1] - 1]. Not part of memory.
+    char *tokens;
+    uint32_t *token_offsets;
+
+    void *memory;
+    size_t memory_size;
+
+    // whether memory is a mapped model file, see load_frozen_chain
+    bool mapped;
+} FrozenChain;
+
+/**
+ * Build a FrozenChain out of the current contents of markov_chain. The
+ * result does not change if markov_chain does.
+ * @param markov_chain the chain to copy
+ * @return a pointer to a FrozenChain, NULL if memory allocation failed.
+ */
+FrozenChain *create_frozen_chain (MarkovChain *markov_chain);
+
+/**
+ * Free frozen_chain (but not the data of its states).
+ * @param frozen_chain frozen_chain to free
+ */
+void free_frozen_chain (FrozenChain **frozen_chain);
+
+/**
+ * @return true if state is a last state of frozen_chain.
+ */
+static inline bool is_last_frozen_state (const FrozenChain *frozen_chain,
+                                         uint32_t state)
+{
+  return (frozen_chain->last_states[state / LAST_STATES_WORD_BITS]
+          >> (state % LAST_STATES_WORD_BITS)) & 1;
+}
+
+/**
+ * Get one random state that is not a last state.
+ * @param frozen_chain
+ * @param rng the random number generator to draw from
+ * @return id of the chosen state, or frozen_chain->states_length if all
+ * the states are last states.
+ */
+uint32_t get_first_frozen_state (const FrozenChain *frozen_chain, Rng *rng);
+
+/**
+ * Choose randomly the next state, depend on it's occurrence frequency.
+ * Takes O(1) with two random draws.
+ * @param frozen_chain
+ * @param state id of the state to choose from, must have successors
+ * @param rng the random number generator to draw from
+ * @return id of the chosen state
+ */
+uint32_t get_next_frozen_state (const FrozenChain *frozen_chain,
+                                uint32_t state,
+                                Rng *rng);
+
+/**
+ * Like generate_random_sequence, over a FrozenChain: generate and print a
+ * random sequence starting at first_state.
+ * @param frozen_chain
+ * @param print_func prints the data of a single state
+ * @param first_state id of the state to start with
+ * @param max_length maximum length of chain to generate
+ * @param rng the random number generator to draw from
+ */
+void generate_frozen_sequence (const FrozenChain *frozen_chain,
+                               print_data print_func,
+                               uint32_t first_state,
+                               int max_length,
+                               Rng *rng);
+
+/**
+ * Like generate_frozen_sequence, but record the ids of the states of the
+ * sequence instead of printing them.
+ * @param frozen_chain
+ * @param first_state id of the state to start with
+ * @param max_length maximum length of chain to generate
+ * @param rng the random number generator to draw from
+ * @param states filled with the ids, must have room for max_length of them
+ *        (and at least 2)
+ * @return length of the sequence, 0 if first_state is not a state
+ */
+int walk_frozen_chain (const FrozenChain *frozen_chain,
+                       uint32_t first_state,
+                       int max_length,
+                       Rng *rng,
+                       uint32_t *states);
+
+/**
+ * Format the text of every state once, and keep it in the chain's tokens,
+ * so that sequences can be written by copying bytes.
+ * @param frozen_chain the chain
+ * @param format_func writes the text of the data of a single state
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+bool format_frozen_tokens (FrozenChain *frozen_chain,
+                           format_data format_func);
+
+/**
+ * Append the cached text of the given states, and a new line, to buffer.
+ * @param frozen_chain the chain, after format_frozen_tokens
+ * @param states ids of the states
+ * @param length number of states
+ * @param buffer the buffer to append to
+ * @return success/failure: true if the process was successful, false in
+ * case of an allocation or IO error.
+ */
+bool write_frozen_states (const FrozenChain *frozen_chain,
+                          const uint32_t *states,
+                          int length,
+                          OutputBuffer *buffer);
+
+/**
+ * Like generate_frozen_sequence, but append the cached text of the
+ * sequence, and a new line, to buffer.
+ * @param frozen_chain the chain, after format_frozen_tokens
+ * @param first_state id of the state to start with
+ * @param max_length maximum length of chain to generate
+ * @param rng the random number generator to draw from
+ * @param buffer the buffer to append to
+ * @return success/failure: true if the process was successful, false in
+ * case of an allocation or IO error.
+ */
+bool write_frozen_sequence (const FrozenChain *frozen_chain,
+                            uint32_t first_state,
+                            int max_length,
+                            Rng *rng,
+                            OutputBuffer *buffer);
+
+/**
+ * Save frozen_chain to a versioned binary model file, that
+ * load_frozen_chain can map back.
+ * @param frozen_chain the chain to save
+ * @param size_func returns the size of the data of a state, which is saved
+ *        as raw bytes
+ * @param path the file to write
+ * @return success/failure: true if the process was successful, false in
+ * case of an IO or allocation error.
+ */
+bool save_frozen_chain (const FrozenChain *frozen_chain,
+                        size_data size_func,
+                        const char *path);
+
+/**
+ * Map a model file written by save_frozen_chain and use it in place: the
+ * arrays and the data of the states all point into the mapping, so
+ * loading takes no allocation per state. The whole file is validated
+ * first, in time linear in its size, so that a corrupt or hostile file
+ * can't make the chain read out of bounds.
+ * @param path the file to load
+ * @param check_func checks the data of every state (may be NULL)
+ * @return a pointer to a FrozenChain, NULL if the file is invalid or an
+ * error occurred. free_frozen_chain unmaps it.
+ */
+FrozenChain *load_frozen_chain (const char *path, check_data check_func);
+
+#endif /* _FROZEN_CHAIN_H */
@@ -7,19 +7,25 @@ int add(LinkedList *link_list, void *data)
     {
         return 1;
     }
-    *new_node = (Node) {data, NULL};
+    new_node->data = data;
+    add_node(link_list, new_node);
+    return 0;
+}
+
+void add_node(LinkedList *link_list, Node *node)
+{
+    node->next = NULL;
 
     if (link_list->first == NULL)
     {
-        link_list->first = new_node;
-        link_list->last = new_node;
+        link_list->first = node;
+        link_list->last = node;
     }
     else
     {
-        link_list->last->next = new_node;
-        link_list->last = new_node;
+        link_list->last->next = node;
+        link_list->last = node;
     }
 
     link_list->size++;
-    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,651 @@
+#define _POSIX_C_SOURCE 200112L // For pthread_barrier_t
+
+#include "markov_analytics.h"
+#include <math.h> // For INFINITY
+#include <pthread.h>
+
+#define CONVERGENCE_TOLERANCE 1e-12
+#define MAX_SWEEPS 2000
+// how close the convergence rates of two successive sweeps must be for
+// compute_expected_steps to extrapolate, relative to 1 - the rate
+#define EXTRAPOLATION_STABILITY 1e-4
+#define MAX_STEP_THREADS 64
+// fewer states than that per thread aren't worth a thread
+#define MIN_STATES_PER_THREAD 4096
+
+/**
+ * The transitions of a FrozenChain by destination (a transposed CSR), as
+ * probabilities: the transitions into state j are from sources[offsets[j]]
+ * to sources[offsets[j + 1] - 1], with their probabilities at the same
+ * positions in probabilities. Absorbing states have no transitions out.
+ */
+typedef struct TransposedChain {
+    uint32_t states_length;
+    uint32_t *offsets;
+    uint32_t *sources;
+    double *probabilities;
+    bool *absorbing;
+    // whether every state is a start state, see get_first_frozen_state
+    bool *starts;
+    uint32_t starts_length;
+} TransposedChain;
+
+/**
+ * A run of the step engine, shared by all of its threads, that takes steps
+ * from current to next until steps_left is 0 or the distribution changes
+ * by less than tolerance.
+ */
+typedef struct StepRun {
+    const TransposedChain *chain;
+    // whether absorbed walks restart (stationary) or stay (k-step)
+    bool restart;
+    double tolerance;
+    int steps_left;
+    double *current;
+    double *next;
+    int threads;
+    // the probability to be absorbed, and the change of the step, of the
+    // states of every thread
+    double absorbed[MAX_STEP_THREADS];
+    double change[MAX_STEP_THREADS];
+    pthread_barrier_t barrier;
+    bool converged;
+
+    // the threads wait for ready before they start, since the number of
+    // threads, and so the states of each one, is only known once they were
+    // all created
+    pthread_mutex_t ready_lock;
+    pthread_cond_t ready_cond;
+    bool ready;
+} StepRun;
+
+/**
+ * The states one thread of a StepRun computes.
+ */
+typedef struct StepWorker {
+    StepRun *run;
+    int index;
+    uint32_t begin;
+    uint32_t end;
+} StepWorker;
+
+/**
+ * @return true if walks end at state.
+ */
+static bool is_absorbing (const FrozenChain *frozen_chain, uint32_t state)
+{
+  return is_last_frozen_state (frozen_chain, state)
+         || frozen_chain->offsets[state] == frozen_chain->offsets[state + 1];
+}
+
+/**
+ * Order the states some walk from which gets absorbed by their distance
+ * (in transitions) from absorption, found with a breadth first search over
+ * the transitions backwards, and the states of every distance from the
+ * last id to the first (so on a board, from its end backwards).
+ * @param frozen_chain the chain
+ * @param absorbed set to whether a walk from every state can be absorbed
+ * @param order filled with those states, the absorbing ones first
+ * @return number of states in order, or -1 in case of allocation error
+ */
+static int64_t order_absorbed_states (const FrozenChain *frozen_chain,
+                                      bool *absorbed, uint32_t *order)
+{
+  uint32_t states_length = frozen_chain->states_length;
+  uint32_t *offsets = calloc ((size_t) states_length + 2, sizeof (uint32_t));
+  uint32_t *sources = malloc (((size_t) frozen_chain->edges_length + 1)
+                              * sizeof (uint32_t));
+  uint32_t *distances = malloc (((size_t) states_length + 1)
+                                * sizeof (uint32_t));
+  if (!offsets || !sources || !distances)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (offsets);
+      free (sources);
+      free (distances);
+      return -1;
+    }
+  // the sources of the transitions into state j are sources[offsets[j]]
+  // to sources[offsets[j + 1] - 1]
+  for (uint32_t edge = 0; edge < frozen_chain->edges_length; ++edge)
+    {
+      offsets[frozen_chain->successors[edge] + 2]++;
+    }
+  for (uint32_t j = 2; j <= states_length + 1; ++j)
+    {
+      offsets[j] += offsets[j - 1];
+    }
+  for (uint32_t i = 0; i < states_length; ++i)
+    {
+      for (uint32_t edge = frozen_chain->offsets[i];
+           edge < frozen_chain->offsets[i + 1]; ++edge)
+        {
+          sources[offsets[frozen_chain->successors[edge] + 1]++] = i;
+        }
+    }
+
+  uint32_t length = 0;
+  for (uint32_t i = 0; i < states_length; ++i)
+    {
+      absorbed[i] = is_absorbing (frozen_chain, i);
+      distances[i] = 0;
+      if (absorbed[i])
+        {
+          order[length++] = i;
+        }
+    }
+  for (uint32_t next = 0; next < length; ++next)
+    {
+      uint32_t j = order[next];
+      // transitions out of absorbing states are never taken
+      for (uint32_t k = offsets[j]; k < offsets[j + 1]; ++k)
+        {
+          if (!absorbed[sources[k]])
+            {
+              absorbed[sources[k]] = true;
+              distances[sources[k]] = distances[j] + 1;
+              order[length++] = sources[k];
+            }
+        }
+    }
+
+  // sort by distance, and by id downwards within a distance (counting
+  // sort, with offsets as the start of every distance)
+  uint32_t max_distance = length ? distances[order[length - 1]] : 0;
+  for (uint32_t d = 0; d <= max_distance + 1; ++d)
+    {
+      offsets[d] = 0;
+    }
+  for (uint32_t k = 0; k < length; ++k)
+    {
+      offsets[distances[order[k]] + 1]++;
+    }
+  for (uint32_t d = 1; d <= max_distance; ++d)
+    {
+      offsets[d] += offsets[d - 1];
+    }
+  for (uint32_t i = states_length; i-- > 0;)
+    {
+      if (absorbed[i])
+        {
+          order[offsets[distances[i]]++] = i;
+        }
+    }
+  free (offsets);
+  free (sources);
+  free (distances);
+  return length;
+}
+
+/**
+ * Sweep the states of order once, closest to absorption first, updating
+ * their expected steps in place.
+ * @param frozen_chain the chain
+ * @param order the states to update, see order_absorbed_states
+ * @param length number of states in order
+ * @param expected the expected steps of every state
+ * @param delta the change of every state in the last sweep, replaced with
+ *        the change of this one
+ * @param rate set to the rate the changes shrink at, relative to the last
+ *        sweep (0 if unknown)
+ * @return the largest change of a state, relative to its value
+ */
+static double sweep_expected_steps (const FrozenChain *frozen_chain,
+                                    const uint32_t *order, int64_t length,
+                                    double *expected, double *delta,
+                                    double *rate)
+{
+  double change = 0, dot = 0, norm = 0;
+  for (int64_t k = 0; k < length; ++k)
+    {
+      uint32_t i = order[k];
+      if (is_absorbing (frozen_chain, i))
+        {
+          continue;
+        }
+      double sum = 0;
+      for (uint32_t edge = frozen_chain->offsets[i];
+           edge < frozen_chain->offsets[i + 1]; ++edge)
+        {
+          sum += frozen_chain->weights[edge]
+                 * expected[frozen_chain->successors[edge]];
+        }
+      double value = 1 + sum / frozen_chain->weight_sums[i];
+      double diff = value - expected[i];
+      dot += diff * delta[i];
+      norm += delta[i] * delta[i];
+      delta[i] = diff;
+      // relative to the value, which may get large
+      double relative = fabs (diff) / value;
+      change = relative > change ? relative : change;
+      expected[i] = value;
+    }
+  *rate = norm > 0 ? dot / norm : 0;
+  return change;
+}
+
+bool compute_expected_steps (const FrozenChain *frozen_chain,
+                             double *expected)
+{
+  uint32_t states_length = frozen_chain->states_length;
+  bool *absorbed = malloc (((size_t) states_length + 1) * sizeof (bool));
+  uint32_t *order = malloc (((size_t) states_length + 1)
+                            * sizeof (uint32_t));
+  double *delta = calloc ((size_t) states_length + 1, sizeof (double));
+  int64_t length = absorbed && order && delta
+                   ? order_absorbed_states (frozen_chain, absorbed, order)
+                   : -1;
+  if (length < 0)
+    {
+      if (!absorbed || !order || !delta)
+        {
+          printf ("%s", ALLOCATION_ERROR_MASSAGE);
+        }
+      free (absorbed);
+      free (order);
+      free (delta);
+      return false;
+    }
+  for (uint32_t i = 0; i < states_length; ++i)
+    {
+      expected[i] = absorbed[i] ? 0 : INFINITY;
+    }
+
+  // states that can be absorbed only lead to such states (with some
+  // probability), so their equations only involve each other. Sweeping
+  // them closest to absorption first carries the values all the way back
+  // in a single sweep (down a whole board), so only the walks that go
+  // back (up snakes) take more sweeps. Their error shrinks by a steady
+  // rate per sweep, so once the rate settles the rest of the geometric
+  // series is added at once.
+  double change = CONVERGENCE_TOLERANCE;
+  double last_rate = 0;
+  for (int sweep = 0; sweep < MAX_SWEEPS && change >= CONVERGENCE_TOLERANCE;
+       ++sweep)
+    {
+      double rate = 0;
+      change = sweep_expected_steps (frozen_chain, order, length, expected,
+                                     delta, &rate);
+      if (rate > 0 && rate < 1
+          && fabs (rate - last_rate) < EXTRAPOLATION_STABILITY * (1 - rate))
+        {
+          for (int64_t k = 0; k < length; ++k)
+            {
+              expected[order[k]] += delta[order[k]] * rate / (1 - rate);
+              delta[order[k]] = 0;
+            }
+          rate = 0;
+        }
+      last_rate = rate;
+    }
+  free (absorbed);
+  free (order);
+  free (delta);
+  return change < CONVERGENCE_TOLERANCE;
+}
+
+bool compute_steps_distribution (const FrozenChain *frozen_chain,
+                                 uint32_t first_state,
+                                 int max_steps,
+                                 double *distribution)
+{
+  uint32_t states_length = frozen_chain->states_length;
+  double *current = calloc (states_length + 1, sizeof (double));
+  double *next = calloc (states_length + 1, sizeof (double));
+  if (!current || !next)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (current);
+      free (next);
+      return false;
+    }
+  current[first_state] = 1;
+  for (int step = 0; step <= max_steps; ++step)
+    {
+      // the walks that are absorbed now leave, and the rest take a step
+      distribution[step] = 0;
+      for (uint32_t i = 0; i < states_length; ++i)
+        {
+          if (current[i] == 0)
+            {
+              continue;
+            }
+          if (is_absorbing (frozen_chain, i))
+            {
+              distribution[step] += current[i];
+              continue;
+            }
+          double share = current[i] / frozen_chain->weight_sums[i];
+          for (uint32_t edge = frozen_chain->offsets[i];
+               edge < frozen_chain->offsets[i + 1]; ++edge)
+            {
+              next[frozen_chain->successors[edge]]
+                  += share * frozen_chain->weights[edge];
+            }
+        }
+      double *swap = current;
+      current = next;
+      next = swap;
+      for (uint32_t i = 0; i < states_length; ++i)
+        {
+          next[i] = 0;
+        }
+    }
+  free (current);
+  free (next);
+  return true;
+}
+
+/**
+ * Transpose the transitions of frozen_chain.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool transpose_chain (const FrozenChain *frozen_chain,
+                             TransposedChain *chain)
+{
+  uint32_t states_length = frozen_chain->states_length;
+  chain->states_length = states_length;
+  chain->offsets = calloc ((size_t) states_length + 1, sizeof (uint32_t));
+  chain->sources = malloc (((size_t) frozen_chain->edges_length + 1)
+                           * sizeof (uint32_t));
+  chain->probabilities = malloc (((size_t) frozen_chain->edges_length + 1)
+                                 * sizeof (double));
+  chain->absorbing = malloc (((size_t) states_length + 1) * sizeof (bool));
+  chain->starts = calloc ((size_t) states_length + 1, sizeof (bool));
+  if (!chain->offsets || !chain->sources || !chain->probabilities
+      || !chain->absorbing || !chain->starts)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return false;
+    }
+  for (uint32_t i = 0; i < states_length; ++i)
+    {
+      chain->absorbing[i] = is_absorbing (frozen_chain, i);
+      for (uint32_t edge = frozen_chain->offsets[i];
+           !chain->absorbing[i] && edge < frozen_chain->offsets[i + 1];
+           ++edge)
+        {
+          chain->offsets[frozen_chain->successors[edge] + 1]++;
+        }
+    }
+  for (uint32_t j = 0; j < states_length; ++j)
+    {
+      chain->offsets[j + 1] += chain->offsets[j];
+    }
+  // i runs in order, so the sources of every state come out sorted
+  for (uint32_t i = 0; i < states_length; ++i)
+    {
+      for (uint32_t edge = frozen_chain->offsets[i];
+           !chain->absorbing[i] && edge < frozen_chain->offsets[i + 1];
+           ++edge)
+        {
+          uint32_t position = chain->offsets[frozen_chain->successors[edge]]++;
+          chain->sources[position] = i;
+          chain->probabilities[position] =
+              (double) frozen_chain->weights[edge]
+              / frozen_chain->weight_sums[i];
+        }
+    }
+  // every offset moved to the next one's place
+  for (uint32_t j = states_length; j > 0; --j)
+    {
+      chain->offsets[j] = chain->offsets[j - 1];
+    }
+  chain->offsets[0] = 0;
+  chain->starts_length = frozen_chain->start_states_length;
+  for (uint32_t i = 0; i < chain->starts_length; ++i)
+    {
+      chain->starts[frozen_chain->start_states[i]] = true;
+    }
+  return true;
+}
+
+/**
+ * Free the arrays of chain.
+ */
+static void free_transposed_chain (TransposedChain *chain)
+{
+  free (chain->offsets);
+  free (chain->sources);
+  free (chain->probabilities);
+  free (chain->absorbing);
+  free (chain->starts);
+}
+
+/**
+ * Take the steps of a StepRun over the states of one worker. Every worker
+ * sums the values of all of them in the same order, so they all agree on
+ * when to stop.
+ * @param arg the StepWorker
+ * @return NULL
+ */
+static void *run_steps (void *arg)
+{
+  StepWorker *worker = arg;
+  StepRun *run = worker->run;
+  const TransposedChain *chain = run->chain;
+  double *current = run->current;
+  double *next = run->next;
+  bool converged = false;
+  for (int step = 0; step < run->steps_left && !converged; ++step)
+    {
+      double absorbed = 0;
+      for (uint32_t i = worker->begin; run->restart && i < worker->end; ++i)
+        {
+          absorbed += chain->absorbing[i] ? current[i] : 0;
+        }
+      run->absorbed[worker->index] = absorbed;
+      pthread_barrier_wait (&run->barrier);
+
+      double restart = 0;
+      for (int t = 0; run->restart && t < run->threads; ++t)
+        {
+          restart += run->absorbed[t];
+        }
+      restart = run->restart ? restart / chain->starts_length : 0;
+      double change = 0;
+      for (uint32_t j = worker->begin; j < worker->end; ++j)
+        {
+          double value = chain->starts[j] ? restart : 0;
+          for (uint32_t edge = chain->offsets[j];
+               edge < chain->offsets[j + 1]; ++edge)
+            {
+              value += chain->probabilities[edge]
+                       * current[chain->sources[edge]];
+            }
+          if (run->restart)
+            {
+              // the lazy chain
+              value = (value + current[j]) / 2;
+            }
+          else if (chain->absorbing[j])
+            {
+              value += current[j];
+            }
+          change += value > current[j] ? value - current[j]
+                                       : current[j] - value;
+          next[j] = value;
+        }
+      run->change[worker->index] = change;
+      pthread_barrier_wait (&run->barrier);
+
+      change = 0;
+      for (int t = 0; t < run->threads; ++t)
+        {
+          change += run->change[t];
+        }
+      converged = change < run->tolerance;
+      double *swap = current;
+      current = next;
+      next = swap;
+    }
+  if (worker->index == 0)
+    {
+      run->current = current;
+      run->converged = converged;
+    }
+  return NULL;
+}
+
+/**
+ * The routine of a thread of a StepRun: wait until the run is ready, and
+ * take its steps.
+ * @param arg the StepWorker
+ * @return NULL
+ */
+static void *run_thread_steps (void *arg)
+{
+  StepRun *run = ((StepWorker *) arg)->run;
+  pthread_mutex_lock (&run->ready_lock);
+  while (!run->ready)
+    {
+      pthread_cond_wait (&run->ready_cond, &run->ready_lock);
+    }
+  pthread_mutex_unlock (&run->ready_lock);
+  return run_steps (arg);
+}
+
+/**
+ * Take up to steps steps of distribution over chain, on up to threads
+ * threads, in place.
+ * @param chain the transposed chain
+ * @param restart whether absorbed walks restart or stay
+ * @param tolerance stop once a step changes the distribution by less than
+ *        that, 0 to take all the steps
+ * @param steps max number of steps
+ * @param threads max number of threads to use
+ * @param distribution the distribution to start from, and the result
+ * @param converged set to whether a step changed the distribution by less
+ *        than tolerance
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation or thread error.
+ */
+static bool take_steps (const TransposedChain *chain, bool restart,
+                        double tolerance, int steps, int threads,
+                        double *distribution, bool *converged)
+{
+  uint32_t states_length = chain->states_length;
+  uint32_t max_threads = states_length / MIN_STATES_PER_THREAD;
+  threads = threads > MAX_STEP_THREADS ? MAX_STEP_THREADS : threads;
+  threads = (uint32_t) threads > max_threads ? (int) max_threads : threads;
+  threads = threads < 1 ? 1 : threads;
+  StepRun *run = malloc (sizeof (StepRun));
+  double *next = malloc (((size_t) states_length + 1) * sizeof (double));
+  if (!run || !next)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (run);
+      free (next);
+      return false;
+    }
+  run->chain = chain;
+  run->restart = restart;
+  run->tolerance = tolerance;
+  run->steps_left = steps;
+  run->current = distribution;
+  run->next = next;
+  run->converged = false;
+  run->ready = false;
+  pthread_mutex_init (&run->ready_lock, NULL);
+  pthread_cond_init (&run->ready_cond, NULL);
+
+  StepWorker workers[MAX_STEP_THREADS];
+  pthread_t handles[MAX_STEP_THREADS];
+  int started = 1;
+  for (int t = 0; t < threads; ++t)
+    {
+      workers[t] = (StepWorker) {run, t, 0, 0};
+    }
+  while (started < threads
+         && pthread_create (&handles[started], NULL, run_thread_steps,
+                            &workers[started]) == 0)
+    {
+      started++;
+    }
+  // the worker of the calling thread is worker 0, so whichever threads
+  // were created, the states are split between the first started workers
+  run->threads = started;
+  for (int t = 0; t < started; ++t)
+    {
+      workers[t].begin = (uint32_t) ((uint64_t) states_length * t / started);
+      workers[t].end = (uint32_t) ((uint64_t) states_length * (t + 1)
+                                   / started);
+    }
+  bool success = pthread_barrier_init (&run->barrier, NULL,
+                                       (unsigned) started) == 0;
+  if (!success)
+    {
+      // no steps, so no worker waits at the barrier
+      run->steps_left = 0;
+    }
+  pthread_mutex_lock (&run->ready_lock);
+  run->ready = true;
+  pthread_cond_broadcast (&run->ready_cond);
+  pthread_mutex_unlock (&run->ready_lock);
+  run_steps (&workers[0]);
+  for (int t = 1; t < started; ++t)
+    {
+      pthread_join (handles[t], NULL);
+    }
+  if (success)
+    {
+      pthread_barrier_destroy (&run->barrier);
+    }
+  pthread_mutex_destroy (&run->ready_lock);
+  pthread_cond_destroy (&run->ready_cond);
+
+  if (success && run->current != distribution)
+    {
+      for (uint32_t i = 0; i < states_length; ++i)
+        {
+          distribution[i] = run->current[i];
+        }
+    }
+  *converged = run->converged;
+  free (run);
+  free (next);
+  return success;
+}
+
+bool compute_stationary_distribution (const FrozenChain *frozen_chain,
+                                      double tolerance,
+                                      int max_iterations,
+                                      int threads,
+                                      double *distribution)
+{
+  if (frozen_chain->start_states_length == 0)
+    {
+      return false;
+    }
+  TransposedChain chain;
+  bool converged = false;
+  bool success = transpose_chain (frozen_chain, &chain);
+  for (uint32_t i = 0; success && i < frozen_chain->states_length; ++i)
+    {
+      distribution[i] = chain.starts[i] ? 1.0 / chain.starts_length : 0;
+    }
+  success = success && take_steps (&chain, true, tolerance, max_iterations,
+                                   threads, distribution, &converged);
+  free_transposed_chain (&chain);
+  return success && converged;
+}
+
+bool compute_k_step_distribution (const FrozenChain *frozen_chain,
+                                  uint32_t first_state,
+                                  int steps,
+                                  int threads,
+                                  double *distribution)
+{
+  TransposedChain chain;
+  bool converged;
+  bool success = transpose_chain (frozen_chain, &chain);
+  for (uint32_t i = 0; success && i < frozen_chain->states_length; ++i)
+    {
+      distribution[i] = i == first_state ? 1 : 0;
+    }
+  success = success && take_steps (&chain, false, 0, steps, threads,
+                                   distribution, &converged);
+  free_transposed_chain (&chain);
+  return success;
+}
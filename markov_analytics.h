@@ -0,0 +1,103 @@
+#ifndef _MARKOV_ANALYTICS_H_
+#define _MARKOV_ANALYTICS_H_
+#include "frozen_chain.h"
+
+/**
+ * Exact analytics of a FrozenChain as an absorbing Markov chain: the walks
+ * of generate_frozen_sequence end at last states, and at states without
+ * successors, so those are its absorbing states. A step is a single
+ * transition, from state i to successor j with probability
+ * weights[j] / weight_sums[i].
+ */
+
+/**
+ * Compute the expected number of steps to absorption from every state, by
+ * solving E[i] = 1 + sum of P(i, j) * E[j] (and E[i] = 0 for absorbing
+ * states) with Gauss-Seidel sweeps over the sparse transitions, the
+ * states closest to absorption first, extrapolated once they converge at a
+ * steady rate.
+ * @param frozen_chain the chain
+ * @param expected filled with the expected steps of every state (an array
+ *        of states_length); INFINITY for states whose walks may never be
+ *        absorbed
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error or if the sweeps didn't converge within a
+ * bounded number of them.
+ */
+bool compute_expected_steps (const FrozenChain *frozen_chain,
+                             double *expected);
+
+/**
+ * Compute the distribution of the number of steps to absorption from
+ * first_state, by pushing the probability of being in every state through
+ * the transitions one step at a time (a sparse matrix-vector product per
+ * step).
+ * @param frozen_chain the chain
+ * @param first_state id of the state to start with
+ * @param max_steps number of steps to compute
+ * @param distribution filled with the probability to be absorbed after
+ *        exactly k steps, for k from 0 to max_steps (max_steps + 1 entries).
+ *        Their sum is less than 1 if walks may take more than max_steps.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+bool compute_steps_distribution (const FrozenChain *frozen_chain,
+                                 uint32_t first_state,
+                                 int max_steps,
+                                 double *distribution);
+
+/**
+ * The distributions below are computed by a step engine: the transitions
+ * are transposed once, so that every entry of the next distribution is a
+ * sum over the transitions into its state, and the entries are split
+ * between up to threads threads. The results are in state order: entry i
+ * is the probability of state i, whose data is frozen_chain->data[i].
+ * They may differ between numbers of threads only in rounding.
+ */
+
+/**
+ * Compute the stationary distribution of the chain with restarts: a walk
+ * that is absorbed starts over from a start state chosen uniformly, like
+ * get_first_frozen_state does, so this is the share of every state among
+ * the states of many consecutive walks. Computed by power iteration of the
+ * lazy chain (which stays in place with probability 1/2, so that it
+ * converges on periodic chains too, to the same distribution), starting
+ * from the uniform distribution of the start states.
+ * @param frozen_chain the chain, with at least one start state
+ * @param tolerance stop when a step changes the distribution by less than
+ *        that (in L1 distance)
+ * @param max_iterations max number of steps
+ * @param threads max number of threads to use
+ * @param distribution filled with the probability of every state (an array
+ *        of states_length)
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation or thread error, if the chain has no start states or
+ * if the iteration didn't converge.
+ */
+bool compute_stationary_distribution (const FrozenChain *frozen_chain,
+                                      double tolerance,
+                                      int max_iterations,
+                                      int threads,
+                                      double *distribution);
+
+/**
+ * Compute the probability of being in every state after exactly steps
+ * steps from first_state, where absorbed walks stay at the state they
+ * were absorbed at (so the probability of an absorbing state is that of
+ * being absorbed there within steps steps).
+ * @param frozen_chain the chain
+ * @param first_state id of the state to start with
+ * @param steps number of steps to take
+ * @param threads max number of threads to use
+ * @param distribution filled with the probability of every state (an array
+ *        of states_length)
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation or thread error.
+ */
+bool compute_k_step_distribution (const FrozenChain *frozen_chain,
+                                  uint32_t first_state,
+                                  int steps,
+                                  int threads,
+                                  double *distribution);
+
+#endif /* _MARKOV_ANALYTICS_H_ */
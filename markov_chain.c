@@ -1,52 +1,61 @@
 #include "markov_chain.h"
+#include "frozen_chain.h"
+#include "markov_stats.h"
+#include <unistd.h> // For STDOUT_FILENO
 
-/**
-* Get random number between 0 and max_number [0, max_number).
-* @param max_number maximal number to return (not including)
-* @return Random number
-*/
-int get_random_number (int max_number)
+#define INDEX_INITIAL_CAPACITY 64
+#define SUCCESSOR_INDEX_THRESHOLD 8
+#define SUCCESSOR_HASH_MULTIPLIER 2654435761u
+
+int get_random_number (Rng *rng, int max_number)
 {
-  return rand () % max_number;
+  return (int) get_bounded_random (rng, (uint32_t) max_number);
 }
 
-MarkovNode *get_first_random_node (MarkovChain *markov_chain)
+MarkovNode *get_first_random_node (MarkovChain *markov_chain, Rng *rng)
 {
-  Node *iter = NULL;
-  do
+  if (markov_chain->start_states_length == 0)
     {
-      iter = markov_chain->database->first;
-      int rand = get_random_number (markov_chain->database->size);
-      for (int i = 0; i < rand; ++i)
-        {
-          iter = iter->next;
-        }
+      return NULL;
     }
-  while (markov_chain->is_last(iter->data->data));
-
-  return iter->data;
+  int rand = get_random_number (rng, markov_chain->start_states_length);
+  return markov_chain->start_states[rand];
 }
 
 /**
- * Count the combined number of cells in the node's counter_list
- * @param state_struct_ptr MarkovNode to count from
- * @return sum of nodes in counter_list
+ * Pick the next state out of the node's alias table: one draw for the
+ * column, and one for the coin that decides between the column and its
+ * alias.
+ * @param state_struct_ptr MarkovNode to choose from, must have a table
+ * @param rng the random number generator to draw from
+ * @return MarkovNode of the chosen state
  */
-int get_counter_list_sum(MarkovNode *state_struct_ptr) {
-  int sum = 0;
-  NextNodeCounter *iter1 = state_struct_ptr->counter_list;
-  for (int j = 0; j < state_struct_ptr->counter_list_length; ++j)
+static MarkovNode *get_next_alias_node (MarkovNode *state_struct_ptr,
+                                        Rng *rng)
+{
+  int column = get_random_number (rng,
+                                  state_struct_ptr->counter_list_length);
+  // the frozen copy scales the frequencies down to fit in an int
+  const FrozenChain *frozen_chain = state_struct_ptr->markov_chain->frozen;
+  int coin = get_random_number (
+      rng, (int) frozen_chain->weight_sums[state_struct_ptr->id]);
+  AliasEntry *entry = state_struct_ptr->alias_table + column;
+  if (coin >= entry->threshold)
     {
-      sum += iter1->frequency;
-      iter1 += 1;
+      column = entry->alias;
     }
-  return sum;
+  return get_counter_node (state_struct_ptr, column);
 }
 
-MarkovNode *get_next_random_node (MarkovNode *state_struct_ptr)
+MarkovNode *get_next_random_node (MarkovNode *state_struct_ptr, Rng *rng)
 {
-  int sum = get_counter_list_sum(state_struct_ptr);
-  int r = get_random_number (sum);
+  COUNT_STAT (samples, 1);
+  if (state_struct_ptr->alias_table)
+    {
+      return get_next_alias_node (state_struct_ptr, rng);
+    }
+  uint64_t r = get_wide_bounded_random (rng,
+                                        state_struct_ptr->counter_list_sum);
 
   NextNodeCounter *iter = state_struct_ptr->counter_list;
   while (r >= iter->frequency)
@@ -54,34 +63,128 @@ MarkovNode *get_next_random_node (MarkovNode *state_struct_ptr)
       r -= iter->frequency;
       iter += 1;
     }
+  COUNT_STAT (scans, 1);
+  COUNT_STAT (scan_steps, iter - state_struct_ptr->counter_list + 1);
 
-  return iter->markov_node->data;
+  return get_counter_node (state_struct_ptr,
+                           (int) (iter - state_struct_ptr->counter_list));
 }
 
 void generate_random_sequence (MarkovChain *markov_chain,
                                MarkovNode *first_node,
-                               int max_length)
+                               int max_length,
+                               Rng *rng)
 {
   MarkovNode *next = NULL;
   if (!first_node)
     {
-      next = get_first_random_node (markov_chain);
+      next = get_first_random_node (markov_chain, rng);
     }
   else
     {
       next = first_node;
     }
-  markov_chain->print_func(next->data);
-  max_length--;
-  do
+  if (!next)
+    {
+      printf ("\n");
+      return;
+    }
+  if (markov_chain->format_func)
+    {
+      OutputBuffer buffer;
+      init_output_buffer (&buffer, STDOUT_FILENO);
+      write_random_sequence (markov_chain, next, max_length, rng, &buffer);
+      flush_output_buffer (&buffer);
+      free_output_buffer (&buffer);
+      return;
+    }
+  if (markov_chain->frozen)
+    {
+      generate_frozen_sequence (markov_chain->frozen,
+                                markov_chain->print_func, next->id,
+                                max_length, rng);
+      return;
+    }
+  MarkovIterator iterator;
+  init_markov_iterator (&iterator, markov_chain, next, max_length, rng);
+  while ((next = get_next_from_iterator (&iterator)))
     {
-      next = get_next_random_node (next);
       markov_chain->print_func(next->data);
     }
-  while (--max_length > 0 && !markov_chain->is_last (next->data));
   printf ("\n");
 }
 
+bool write_random_sequence (MarkovChain *markov_chain,
+                            MarkovNode *first_node,
+                            int max_length,
+                            Rng *rng,
+                            OutputBuffer *buffer)
+{
+  MarkovNode *next = first_node ? first_node
+                                : get_first_random_node (markov_chain, rng);
+  if (!next)
+    {
+      return append_to_output (buffer, "\n", 1);
+    }
+  if (markov_chain->frozen && markov_chain->frozen->tokens)
+    {
+      return write_frozen_sequence (markov_chain->frozen, next->id,
+                                    max_length, rng, buffer);
+    }
+  bool success = true;
+  MarkovIterator iterator;
+  init_markov_iterator (&iterator, markov_chain, next, max_length, rng);
+  while ((next = get_next_from_iterator (&iterator)))
+    {
+      success = append_formatted_to_output (buffer,
+                                            markov_chain->format_func,
+                                            next->data) && success;
+    }
+  return append_to_output (buffer, "\n", 1) && success;
+}
+
+void init_markov_iterator (MarkovIterator *iterator,
+                           MarkovChain *markov_chain,
+                           MarkovNode *first_node,
+                           int max_length,
+                           Rng *rng)
+{
+  *iterator = (MarkovIterator) {markov_chain, first_node, NULL, rng,
+                                max_length, 0, false};
+}
+
+MarkovNode *get_next_from_iterator (MarkovIterator *iterator)
+{
+  if (iterator->done)
+    {
+      return NULL;
+    }
+  MarkovNode *current = iterator->current;
+  if (!current)
+    {
+      current = iterator->first_node
+                ? iterator->first_node
+                : get_first_random_node (iterator->markov_chain,
+                                         iterator->rng);
+    }
+  // a sequence has at least 2 states, and the first one may be a last state
+  else if ((iterator->length >= 2
+            && (iterator->length >= iterator->max_length
+                || current->is_last))
+           || current->counter_list_length == 0)
+    {
+      current = NULL;
+    }
+  else
+    {
+      current = get_next_random_node (current, iterator->rng);
+    }
+  iterator->current = current;
+  iterator->length++;
+  iterator->done = !current;
+  return current;
+}
+
 MarkovChain *create_markov_chain ()
 {
   MarkovChain *markov_chain = calloc (1, sizeof (MarkovChain));
@@ -97,6 +200,8 @@ MarkovChain *create_markov_chain ()
       free (markov_chain);
       return NULL;
     }
+  COUNT_STAT (allocations, 2);
+  COUNT_STAT (bytes_allocated, sizeof (MarkovChain) + sizeof (LinkedList));
 
   return markov_chain;
 }
@@ -104,105 +209,300 @@ MarkovChain *create_markov_chain ()
 
 void free_markov_chain (MarkovChain **ptr_chain)
 {
-  Node *chain_iter = (*ptr_chain)->database->first;
-  Node *temp = NULL;
-  for (int i = 0; i < (*ptr_chain)->database->size; ++i)
+  for (Node *chain_iter = (*ptr_chain)->database->first; chain_iter;
+       chain_iter = chain_iter->next)
     {
-
-
       free (chain_iter->data->counter_list);
-      (*ptr_chain)->free_data(chain_iter->data->data);
-      free (chain_iter->data);
-
-      temp = chain_iter;
-      chain_iter = chain_iter->next;
-      free (temp);
+      free (chain_iter->data->successor_index);
+      if ((*ptr_chain)->free_data)
+        {
+          (*ptr_chain)->free_data(chain_iter->data->data);
+        }
     }
 
+  // the Nodes and MarkovNodes themselves
+  free_arena (&(*ptr_chain)->node_arena);
+  free_frozen_chain (&(*ptr_chain)->frozen);
+  free ((*ptr_chain)->states);
+  free ((*ptr_chain)->start_states);
+  free ((*ptr_chain)->index.slots);
+  free ((*ptr_chain)->index.hashes);
   free ((*ptr_chain)->database);
   free (*ptr_chain);
 }
 
 
 /**
- * Create a new counter list if empty, and add second_node to the
- *  counter list of first_node
- * @param first_node the node with the new list to create
- * @param second_node the node to add to the list
- * @param markov_chain the database containing the markov chain.
- * @return success/failure: true if the process was successful, false if in
- * case of allocation error.
+ * Drop the chain's frozen copy, and the alias tables pointing into it.
  */
-bool create_new_counter_list(MarkovNode *first_node,
-                             MarkovNode *second_node,
-                             MarkovChain *markov_chain)
+static void thaw_markov_chain (MarkovChain *markov_chain)
 {
-  NextNodeCounter*  new_list = calloc (1, sizeof (NextNodeCounter));
-  if (!new_list)
+  if (!markov_chain->frozen)
     {
-      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return;
+    }
+  for (int i = 0; i < markov_chain->database->size; ++i)
+    {
+      markov_chain->states[i]->data->alias_table = NULL;
+    }
+  free_frozen_chain (&markov_chain->frozen);
+}
+
+bool freeze_markov_chain (MarkovChain *markov_chain)
+{
+  thaw_markov_chain (markov_chain);
+  FrozenChain *frozen_chain = create_frozen_chain (markov_chain);
+  if (!frozen_chain
+      || (markov_chain->format_func
+          && !format_frozen_tokens (frozen_chain,
+                                    markov_chain->format_func)))
+    {
+      free_frozen_chain (&frozen_chain);
       return false;
     }
-  new_list->markov_node = get_node_from_database (markov_chain,
-                                             second_node->data);
-  new_list->frequency = 1;
-  first_node->counter_list = new_list;
-  first_node->counter_list_length += 1;
+  for (int i = 0; i < markov_chain->database->size; ++i)
+    {
+      MarkovNode *markov_node = markov_chain->states[i]->data;
+      if (markov_node->counter_list_length > 0)
+        {
+          markov_node->alias_table = frozen_chain->alias_table
+                                     + frozen_chain->offsets[i];
+        }
+    }
+  markov_chain->frozen = frozen_chain;
+  return true;
+}
 
+/**
+ * Make sure the dynamic array has room for needed elements, doubling its
+ * capacity if not.
+ * @param array pointer to the array to grow
+ * @param capacity pointer to the array's capacity, in elements
+ * @param needed number of elements the array should fit
+ * @param elem_size size of a single element
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error (the array is left untouched).
+ */
+static bool reserve (void **array, int *capacity, int needed,
+                     size_t elem_size)
+{
+  if (needed <= *capacity)
+    {
+      return true;
+    }
+  int new_capacity = *capacity ? *capacity : 1;
+  while (new_capacity < needed)
+    {
+      new_capacity *= 2;
+    }
+  void *grown = realloc (*array, new_capacity * elem_size);
+  if (!grown)
+    {
+      return false;
+    }
+  if (*array)
+    {
+      COUNT_STAT (reallocations, 1);
+    }
+  else
+    {
+      COUNT_STAT (allocations, 1);
+    }
+  COUNT_STAT (bytes_allocated, new_capacity * elem_size);
+  *array = grown;
+  *capacity = new_capacity;
   return true;
 }
 
 /**
- * Iterate over the first_node's chain. If the chain contains the
- * second_node's data, then increment it's frequency by 1.
- * @param first_node the node with the list to iterate
+ * Slot of a successor id in a node's successor_index.
+ */
+static int successor_slot (int id, int capacity)
+{
+  return (int) (((unsigned int) id * SUCCESSOR_HASH_MULTIPLIER)
+                & (unsigned int) (capacity - 1));
+}
+
+/**
+ * Place the counter_list entry at position in first_node's
+ * successor_index. Assumes the index has a free slot.
+ */
+static void place_successor (MarkovNode *first_node, int position)
+{
+  int mask = first_node->successor_index_capacity - 1;
+  int id = (int) first_node->counter_list[position].id;
+  int i = successor_slot (id, first_node->successor_index_capacity);
+  while (first_node->successor_index[i])
+    {
+      i = (i + 1) & mask;
+    }
+  first_node->successor_index[i] = position + 1;
+}
+
+/**
+ * (Re)build first_node's successor_index over its whole counter_list, with
+ * room for the counter_list's capacity at a load factor of at most one
+ * half.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool build_successor_index (MarkovNode *first_node)
+{
+  int capacity = first_node->successor_index_capacity
+                 ? first_node->successor_index_capacity : 1;
+  while (capacity < first_node->counter_list_capacity * 2)
+    {
+      capacity *= 2;
+    }
+  int *slots = calloc (capacity, sizeof (int));
+  if (!slots)
+    {
+      return false;
+    }
+  COUNT_STAT (allocations, 1);
+  COUNT_STAT (bytes_allocated, capacity * sizeof (int));
+  free (first_node->successor_index);
+  first_node->successor_index = slots;
+  first_node->successor_index_capacity = capacity;
+  for (int i = 0; i < first_node->counter_list_length; ++i)
+    {
+      place_successor (first_node, i);
+    }
+  return true;
+}
+
+/**
+ * Find second_node in the counter_list of first_node, through its
+ * successor_index if it has one, by scanning otherwise.
+ * @param first_node the node with the list to look in
+ * @param second_node the node we are looking for
+ * @return the position of second_node in the counter_list, -1 if not found
+ */
+static int find_in_counter_list (MarkovNode *first_node,
+                                 MarkovNode *second_node)
+{
+  NextNodeCounter *list = first_node->counter_list;
+  if (!first_node->successor_index)
+    {
+      for (int i = 0; i < first_node->counter_list_length; ++i)
+        {
+          if (list[i].id == (uint32_t) second_node->id)
+            {
+              return i;
+            }
+        }
+      return -1;
+    }
+  int mask = first_node->successor_index_capacity - 1;
+  for (int i = successor_slot (second_node->id,
+                               first_node->successor_index_capacity);
+       first_node->successor_index[i]; i = (i + 1) & mask)
+    {
+      int position = first_node->successor_index[i] - 1;
+      if (list[position].id == (uint32_t) second_node->id)
+        {
+          return position;
+        }
+    }
+  return -1;
+}
+
+/**
+ * Look for the second_node's data in the first_node's counter_list. If
+ * found, then increment it's frequency by the given frequency.
+ * @param first_node the node with the list to look in
  * @param second_node the node with the data we are looking for
+ * @param frequency the number of times to count second_node
  * @return success/failure: true if the process was successful, false if
  * word is not found
  */
 bool word_found_in_counter_list(MarkovNode *first_node,
-                                MarkovNode *second_node)
+                                MarkovNode *second_node,
+                                uint32_t frequency)
 {
-  int i = 0;
-  NextNodeCounter *iter = first_node->counter_list;
-  while (i < first_node->counter_list_length)
+  int position = find_in_counter_list (first_node, second_node);
+  if (position < 0)
     {
-      if (second_node - iter->markov_node->data == 0)
-        {
-          iter->frequency += 1;
-          return true;
-        }
-      i++;
-      iter = first_node->counter_list + i;
+      return false;
     }
-    return false;
+  // a single frequency is 32 bits, so it saturates instead of wrapping
+  uint32_t *count = &first_node->counter_list[position].frequency;
+  uint32_t added = frequency > UINT32_MAX - *count
+                   ? UINT32_MAX - *count : frequency;
+  *count += added;
+  first_node->counter_list_sum += added;
+  return true;
 }
 
 /**
- * Add a new node to the counter_list of first_node.
+ * Add a new node to the counter_list of first_node. The counter_list grows
+ * geometrically, and once it is longer than SUCCESSOR_INDEX_THRESHOLD it
+ * gets a successor_index that grows along with it.
  * @param first_node the node with the counter_list to add to
  * @param second_node the node to add to the list
  * @param markov_chain the database containing the markov chain.
+ * @param frequency the frequency of the new entry
  * @return success/failure: true if the process was successful, false if in
  * case of allocation error.
  */
 bool add_new_node_to_counter_list(MarkovNode *first_node,
                                   MarkovNode *second_node,
-                                  MarkovChain *markov_chain)
+                                  MarkovChain *markov_chain,
+                                  uint32_t frequency)
 {
+  // the ids refer to the states of first_node's own chain
+  (void) markov_chain;
   int len = first_node->counter_list_length;
-  first_node->counter_list = realloc (first_node->counter_list,
-                                      (len + 1) * sizeof (NextNodeCounter));
-  if (!first_node->counter_list)
+  if (!reserve ((void **) &first_node->counter_list,
+                &first_node->counter_list_capacity, len + 1,
+                sizeof (NextNodeCounter)))
     {
       printf ("%s", ALLOCATION_ERROR_MASSAGE);
       return false;
     }
   NextNodeCounter *new_node = first_node->counter_list + len;
-  new_node->markov_node = get_node_from_database (markov_chain,
-                                              second_node->data);
-  new_node->frequency = 1;
+  new_node->id = (uint32_t) second_node->id;
+  new_node->frequency = frequency;
   first_node->counter_list_length += 1;
+  first_node->counter_list_sum += frequency;
+
+  if (first_node->counter_list_length <= SUCCESSOR_INDEX_THRESHOLD)
+    {
+      return true;
+    }
+  if (first_node->successor_index
+      && first_node->successor_index_capacity
+         >= first_node->counter_list_length * 2)
+    {
+      place_successor (first_node, len);
+      return true;
+    }
+  if (!build_successor_index (first_node))
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return false;
+    }
+  return true;
+}
+
+/**
+ * Count second_node frequency times in the counter list of first_node.
+ * @return success/failure: true if the process was successful, false if in
+ * case of allocation error.
+ */
+static bool count_in_counter_list (MarkovNode *first_node,
+                                   MarkovNode *second_node,
+                                   MarkovChain *markov_chain,
+                                   uint32_t frequency)
+{
+  // the frozen copy no longer matches the chain
+  thaw_markov_chain (markov_chain);
+
+  if (!word_found_in_counter_list(first_node, second_node, frequency))
+    {
+      return add_new_node_to_counter_list(first_node, second_node,
+                                          markov_chain, frequency);
+    }
 
   return true;
 }
@@ -211,17 +511,153 @@ bool add_node_to_counter_list (MarkovNode *first_node,
                                MarkovNode *second_node,
                                MarkovChain *markov_chain)
 {
-  if (first_node->counter_list_length == 0)
+  return count_in_counter_list (first_node, second_node, markov_chain, 1);
+}
+
+bool add_counts_to_counter_list (MarkovNode *first_node,
+                                 MarkovNode *second_node,
+                                 MarkovChain *markov_chain,
+                                 uint32_t frequency)
+{
+  return count_in_counter_list (first_node, second_node, markov_chain,
+                                frequency);
+}
+
+/**
+ * Give the database's last node the next id, and add it to the states
+ * array (and to the start states, unless it's a last state).
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool register_state (MarkovChain *markov_chain, Node *node)
+{
+  int id = markov_chain->database->size - 1;
+  if (!reserve ((void **) &markov_chain->states,
+                &markov_chain->states_capacity, id + 1, sizeof (Node *)))
     {
-      return create_new_counter_list(first_node, second_node, markov_chain);
+      return false;
     }
-  else
+  node->data->id = id;
+  markov_chain->states[id] = node;
+
+  if (node->data->is_last)
     {
-      if (!word_found_in_counter_list(first_node, second_node)) {
-          add_new_node_to_counter_list(first_node, second_node, markov_chain);
-      }
+      return true;
     }
+  int len = markov_chain->start_states_length;
+  if (!reserve ((void **) &markov_chain->start_states,
+                &markov_chain->start_states_capacity, len + 1,
+                sizeof (MarkovNode *)))
+    {
+      return false;
+    }
+  markov_chain->start_states[len] = node->data;
+  markov_chain->start_states_length++;
+  return true;
+}
 
+/**
+ * Look for data_ptr in the chain's hash index.
+ * @param markov_chain the chain to look in its index
+ * @param data_ptr the state to look for
+ * @param hash hash_func of data_ptr
+ * @return Pointer to the Node wrapping given state, NULL if state not in
+ * index.
+ */
+static Node *find_in_index (MarkovChain *markov_chain, void *data_ptr,
+                            unsigned long hash)
+{
+  // DEFINE_SPECIALIZED_CHAIN (markov_chain_specialize.h) probes the same way
+  StateIndex *index = &markov_chain->index;
+  COUNT_STAT (lookups, 1);
+  if (index->capacity == 0)
+    {
+      return NULL;
+    }
+  size_t mask = index->capacity - 1;
+  for (size_t i = hash & mask; index->slots[i]; i = (i + 1) & mask)
+    {
+      if (index->hashes[i] != hash)
+        {
+          continue;
+        }
+      COUNT_STAT (comparisons, 1);
+      if (markov_chain->comp_func (index->slots[i]->data->data,
+                                   data_ptr) == 0)
+        {
+          return index->slots[i];
+        }
+    }
+  return NULL;
+}
+
+/**
+ * Place node in the first free slot of its probe sequence. Assumes the
+ * index has a free slot.
+ */
+static void place_in_index (StateIndex *index, Node *node, unsigned long hash)
+{
+  size_t mask = index->capacity - 1;
+  size_t i = hash & mask;
+  while (index->slots[i])
+    {
+      i = (i + 1) & mask;
+    }
+  index->slots[i] = node;
+  index->hashes[i] = hash;
+}
+
+/**
+ * Double the capacity of the index (or create it if empty), re-placing all
+ * of its nodes by their stored hashes.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool grow_index (StateIndex *index)
+{
+  size_t new_capacity = index->capacity ? index->capacity * 2
+                                        : INDEX_INITIAL_CAPACITY;
+  StateIndex grown = {calloc (new_capacity, sizeof (Node *)),
+                      malloc (new_capacity * sizeof (unsigned long)),
+                      new_capacity, index->count};
+  if (!grown.slots || !grown.hashes)
+    {
+      free (grown.slots);
+      free (grown.hashes);
+      return false;
+    }
+  COUNT_STAT (allocations, 2);
+  COUNT_STAT (bytes_allocated,
+              new_capacity * (sizeof (Node *) + sizeof (unsigned long)));
+  for (size_t i = 0; i < index->capacity; ++i)
+    {
+      if (index->slots[i])
+        {
+          place_in_index (&grown, index->slots[i], index->hashes[i]);
+        }
+    }
+  free (index->slots);
+  free (index->hashes);
+  *index = grown;
+  return true;
+}
+
+/**
+ * Add node to the chain's hash index, growing it to keep the load factor
+ * at most one half.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool add_to_index (MarkovChain *markov_chain, Node *node,
+                          unsigned long hash)
+{
+  StateIndex *index = &markov_chain->index;
+  if ((index->count + 1) * 2 > index->capacity && !grow_index (index))
+    {
+      return false;
+    }
+  place_in_index (index, node, hash);
+  index->count++;
   return true;
 }
 
@@ -231,7 +667,14 @@ Node *get_node_from_database (MarkovChain *markov_chain, void *data_ptr)
     {
       return NULL;
     }
+  if (markov_chain->hash_func)
+    {
+      return find_in_index (markov_chain, data_ptr,
+                            markov_chain->hash_func (data_ptr));
+    }
+  COUNT_STAT (lookups, 1);
   Node *iter = markov_chain->database->first;
+  COUNT_STAT (comparisons, 1);
   while (markov_chain->comp_func(iter->data->data, data_ptr) != 0)
     {
       iter = iter->next;
@@ -239,38 +682,124 @@ Node *get_node_from_database (MarkovChain *markov_chain, void *data_ptr)
         {
           return NULL;
         }
+      COUNT_STAT (comparisons, 1);
     }
 
   return iter;
 }
 
 /**
- * Create a new markov_node, and returns it.
- * @param data_ptr the string to add to the node's data
- * @return the new markov_node
+ * Create a new markov_node wrapped in a new Node, both allocated out of
+ * the chain's node_arena, and returns the Node.
+ * @param data_ptr the data to copy into the node's data
+ * @return the new Node
  * returns NULL in case of memory allocation failure.
  */
-MarkovNode *create_markov_node (MarkovChain *markov_chain, void *data_ptr)
+static Node *create_markov_node (MarkovChain *markov_chain, void *data_ptr)
 {
-  MarkovNode *markov_node = calloc (1, sizeof (MarkovNode));
+  Node *node = allocate_from_arena (&markov_chain->node_arena,
+                                    sizeof (Node));
+  MarkovNode *markov_node = allocate_from_arena (&markov_chain->node_arena,
+                                                 sizeof (MarkovNode));
+  if (!node || !markov_node)
+    {
+      return NULL;
+    }
+  *markov_node = (MarkovNode) {0};
+  markov_node->markov_chain = markov_chain;
+  COUNT_STAT (allocations, 1);
+  COUNT_STAT (bytes_allocated, sizeof (Node) + sizeof (MarkovNode));
   markov_node->data = markov_chain->copy_func(data_ptr);
+  if (!markov_node->data)
+    {
+      return NULL;
+    }
+  markov_node->is_last = markov_chain->is_last (markov_node->data);
+  node->data = markov_node;
 
-  return markov_node;
+  return node;
 }
 
 Node *add_to_database (MarkovChain *markov_chain, void *data_ptr)
 {
-  Node *node = get_node_from_database (markov_chain, data_ptr);
+  if (!data_ptr)
+    {
+      return NULL;
+    }
+  unsigned long hash = 0;
+  Node *node = NULL;
+  if (markov_chain->hash_func)
+    {
+      hash = markov_chain->hash_func (data_ptr);
+      node = find_in_index (markov_chain, data_ptr, hash);
+    }
+  else
+    {
+      node = get_node_from_database (markov_chain, data_ptr);
+    }
+  return node ? node : add_new_to_database (markov_chain, data_ptr, hash);
+}
+
+Node *add_new_to_database (MarkovChain *markov_chain, void *data_ptr,
+                           unsigned long hash)
+{
+  thaw_markov_chain (markov_chain);
+  Node *node = create_markov_node (markov_chain, data_ptr);
   if (!node)
     {
-      MarkovNode *markov_node = create_markov_node (markov_chain, data_ptr);
-      if (!markov_node || add (markov_chain->database, markov_node) == 1)
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free_markov_chain (&markov_chain);
+      return NULL;
+    }
+  add_node (markov_chain->database, node);
+  if (!register_state (markov_chain, node)
+      || (markov_chain->hash_func
+          && !add_to_index (markov_chain, node, hash)))
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free_markov_chain (&markov_chain);
+      return NULL;
+    }
+  return node;
+}
+
+bool merge_markov_chain (MarkovChain *markov_chain, MarkovChain *source)
+{
+  int size = source->database->size;
+  Node **merged = malloc ((size + 1) * sizeof (Node *));
+  if (!merged)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return false;
+    }
+  COUNT_STAT (allocations, 1);
+  COUNT_STAT (bytes_allocated, (size + 1) * sizeof (Node *));
+  for (int i = 0; i < size; ++i)
+    {
+      merged[i] = add_to_database (markov_chain,
+                                   source->states[i]->data->data);
+      if (!merged[i])
         {
-          printf ("%s", ALLOCATION_ERROR_MASSAGE);
-          free_markov_chain (&markov_chain);
-          return NULL;
+          // add_to_database already freed markov_chain
+          free (merged);
+          return false;
         }
-      node = get_node_from_database (markov_chain, data_ptr);
     }
-  return node;
+  for (int i = 0; i < size; ++i)
+    {
+      MarkovNode *markov_node = source->states[i]->data;
+      for (int j = 0; j < markov_node->counter_list_length; ++j)
+        {
+          NextNodeCounter *counter = markov_node->counter_list + j;
+          if (!count_in_counter_list (merged[i]->data,
+                                      merged[counter->id]->data,
+                                      markov_chain, counter->frequency))
+            {
+              free (merged);
+              return false;
+            }
+        }
+    }
+  free (merged);
+  return true;
 }
@@ -2,6 +2,9 @@
 #define _MARKOV_CHAIN_H
 
 #include "linked_list.h"
+#include "arena.h"
+#include "rng.h"
+#include "output_buffer.h"
 #include <stdio.h>  // For printf(), sscanf()
 #include <stdlib.h> // For exit(), malloc()
 #include <stdbool.h> // for bool
@@ -18,24 +21,81 @@ typedef int (*comp_data)(void*, void*);
 typedef void (*free_data_data)(void*);
 typedef void* (*copy_data)(void*);
 typedef bool (*is_last_data)(void*);
+typedef unsigned long (*hash_data)(void*);
 /***************************/
 
 
 /***************************/
 /*        STRUCTS          */
 /***************************/
+/**
+ * An entry of a counter_list: the id of the successor (its position in the
+ * chain's states array) and the number of times it was counted, in 8 bytes.
+ */
 typedef struct NextNodeCounter {
-    Node* markov_node;
-    int frequency;
+    uint32_t id;
+    uint32_t frequency;
 } NextNodeCounter;
 
+/**
+ * One column of a Walker/Vose alias table: the column's own entry is chosen
+ * if a coin drawn from [0, sum of frequencies) is below threshold, and the
+ * entry at index alias otherwise.
+ */
+typedef struct AliasEntry {
+    int threshold;
+    int alias;
+} AliasEntry;
+
 typedef struct MarkovNode {
     void* data;
+
+    // the chain the node belongs to, whose states the ids of the
+    // counter_list refer to
+    struct MarkovChain *markov_chain;
+
+    // position of the node in the chain's states array
+    int id;
+
+    // whether data is a last state, by the chain's is_last when the node
+    // was added
+    bool is_last;
+
     NextNodeCounter* counter_list;
     int counter_list_length;
+
+    // number of entries counter_list has room for
+    int counter_list_capacity;
+
+    // open addressing index of counter_list by successor id, holding
+    // position + 1 (0 is an empty slot). Built once counter_list gets long,
+    // NULL before that.
+    int *successor_index;
+    int successor_index_capacity;
+
+    // sum of the frequencies in counter_list, which may overflow 32 bits
+    uint64_t counter_list_sum;
+
+    // alias table over counter_list, pointing into the chain's frozen
+    // copy. NULL if the chain is not frozen.
+    AliasEntry *alias_table;
 } MarkovNode;
 
-/* DO NOT ADD or CHANGE variable names in this struct */
+/**
+ * Open addressing hash index over the chain's database. Each occupied slot
+ * holds a Node of the database together with the hash of its data, so the
+ * table can grow without calling hash_func again. The capacity is a power
+ * of 2, and a lookup probes linearly from slot hash & (capacity - 1) to the
+ * first empty slot.
+ */
+typedef struct StateIndex {
+    Node **slots;
+    unsigned long *hashes;
+    size_t capacity;
+    size_t count;
+} StateIndex;
+
+/* DO NOT CHANGE the original variable names in this struct */
 typedef struct MarkovChain {
     LinkedList *database;
 
@@ -45,13 +105,17 @@ typedef struct MarkovChain {
 
     // pointer to a func that gets 2 pointers of generic data type(same one)
     // and compare between them */
+    // the first is always data of the chain, and the second the data_ptr
+    // given to get_node_from_database or add_to_database. The latter may
+    // be a lookup key of another type, as long as copy_func and hash_func
+    // take that type as well.
     // returns: - a positive value if the first is bigger
     //          - a negative value if the second is bigger
     //          - 0 if equal
     comp_data comp_func;
 
     // a pointer to a function that gets a pointer of generic data type
-    // and frees it.
+    // and frees it. NULL if the data is owned (and freed) elsewhere.
     // returns void.
     free_data_data free_data;
 
@@ -64,33 +128,160 @@ typedef struct MarkovChain {
     //  and returns:
     //      - true if it's the last state.
     //      - false otherwise.
+    //  called once for every state, when it is added (see
+    //  MarkovNode->is_last).
     is_last_data is_last;
+
+    // optional: a pointer to a func that writes the text of data of a
+    // generic type into a buffer, see format_data. When set, sequences are
+    // written through OutputBuffers (see write_random_sequence), and
+    // freeze_markov_chain caches the text of every state; print_func is
+    // only used when it is NULL.
+    format_data format_func;
+
+    // optional: a pointer to a function that gets a pointer of generic data
+    // type (a data_ptr, as the second argument of comp_func) and returns its
+    // hash. data that compares equal by comp_func must hash equally. Must
+    // be set before the first state is added; when NULL, lookups fall back
+    // to a linear scan of the database.
+    hash_data hash_func;
+
+    // index over database, kept in sync by add_to_database when hash_func
+    // is set.
+    StateIndex index;
+
+    // the Nodes of database in insertion order, so states[i]->data->id == i
+    Node **states;
+    int states_capacity;
+
+    // the markov_nodes that are not last states, in insertion order
+    MarkovNode **start_states;
+    int start_states_length;
+    int start_states_capacity;
+
+    // the Nodes of database and their MarkovNodes are allocated out of
+    // node_arena, and freed all at once with it.
+    Arena node_arena;
+
+    // CSR copy of the chain made by freeze_markov_chain, NULL if the chain
+    // changed since (or was never frozen).
+    struct FrozenChain *frozen;
 } MarkovChain;
 
 /**
- * Get one random state from the given markov_chain's database.
+ * A random walk over a MarkovChain, that generates its sequence one state
+ * at a time (see get_next_from_iterator), the same way
+ * generate_random_sequence does. Several iterators may walk the same chain
+ * at the same time, as long as the chain doesn't change.
+ */
+typedef struct MarkovIterator {
+    MarkovChain *markov_chain;
+    MarkovNode *first_node;
+    // the state returned last, NULL before the first one
+    MarkovNode *current;
+    Rng *rng;
+    int max_length;
+    // number of states returned so far
+    int length;
+    bool done;
+} MarkovIterator;
+
+/**
+ * @param markov_node the node with the counter_list
+ * @param position position in the counter_list
+ * @return the MarkovNode of the successor at position
+ */
+static inline MarkovNode *get_counter_node (const MarkovNode *markov_node,
+                                            int position)
+{
+  uint32_t id = markov_node->counter_list[position].id;
+  return markov_node->markov_chain->states[id]->data;
+}
+
+/**
+* Get random number between 0 and max_number [0, max_number), without bias.
+* @param rng the random number generator to draw from
+* @param max_number maximal number to return (not including)
+* @return Random number
+*/
+int get_random_number (Rng *rng, int max_number);
+
+/**
+ * Get one random state from the given markov_chain's database, that is not
+ * a last state. Takes O(1).
  * @param markov_chain
- * @return
+ * @param rng the random number generator to draw from
+ * @return the chosen MarkovNode, NULL if all the states are last states.
  */
-MarkovNode* get_first_random_node(MarkovChain *markov_chain);
+MarkovNode* get_first_random_node(MarkovChain *markov_chain, Rng *rng);
 
 /**
  * Choose randomly the next state, depend on it's occurrence frequency.
+ * Takes O(1) if the node has an alias table (see freeze_markov_chain),
+ * otherwise scans its counter_list.
  * @param state_struct_ptr MarkovNode to choose from
+ * @param rng the random number generator to draw from
  * @return MarkovNode of the chosen state
  */
-MarkovNode* get_next_random_node(MarkovNode *state_struct_ptr);
+MarkovNode* get_next_random_node(MarkovNode *state_struct_ptr, Rng *rng);
 
 /**
  * Receive markov_chain, generate and print random sentence out of it. The
- * sentence most have at least 2 words in it.
+ * sentence most have at least 2 words in it. Walks the chain's frozen copy
+ * if it has one. If the chain has a format_func, this is a wrapper of
+ * write_random_sequence that writes to stdout.
  * @param markov_chain
  * @param first_node markov_node to start with, if NULL- choose a
  *        random markov_node
  * @param  max_length maximum length of chain to generate
+ * @param rng the random number generator to draw from, so that sequences
+ *        of different generators can be generated in parallel
  */
 void generate_random_sequence(MarkovChain *markov_chain, MarkovNode *
-first_node, int max_length);
+first_node, int max_length, Rng *rng);
+
+/**
+ * Like generate_random_sequence, but append the text of the sequence (and
+ * a new line) to buffer, instead of printing it state by state. Takes the
+ * cached text of the states if the chain is frozen, without formatting.
+ * @param markov_chain the chain, which must have a format_func
+ * @param first_node markov_node to start with, if NULL- choose a
+ *        random markov_node
+ * @param max_length maximum length of chain to generate
+ * @param rng the random number generator to draw from
+ * @param buffer the buffer to append to
+ * @return success/failure: true if the process was successful, false in
+ * case of an allocation or IO error.
+ */
+bool write_random_sequence (MarkovChain *markov_chain,
+                            MarkovNode *first_node,
+                            int max_length,
+                            Rng *rng,
+                            OutputBuffer *buffer);
+
+/**
+ * Start a random walk over markov_chain. No state is generated until
+ * get_next_from_iterator is called.
+ * @param iterator the iterator to initialize
+ * @param markov_chain the chain to walk
+ * @param first_node markov_node to start with, if NULL- choose a
+ *        random markov_node
+ * @param max_length maximum length of the sequence (it is at least 2)
+ * @param rng the random number generator to draw from, owned by the caller
+ */
+void init_markov_iterator (MarkovIterator *iterator,
+                           MarkovChain *markov_chain,
+                           MarkovNode *first_node,
+                           int max_length,
+                           Rng *rng);
+
+/**
+ * Generate the next state of the walk. The caller may stop at any point.
+ * @param iterator the walk
+ * @return the next markov_node of the sequence, NULL once it ended (a last
+ * state, a state without successors or max_length was reached).
+ */
+MarkovNode *get_next_from_iterator (MarkovIterator *iterator);
 
 /**
  * Allocates memory to create MarkovChain instance.
@@ -98,6 +289,18 @@ first_node, int max_length);
  */
 MarkovChain *create_markov_chain ();
 
+/**
+ * Make a read-only CSR copy of the chain (see FrozenChain) with an alias
+ * table for every markov_node, so that get_next_random_node takes O(1)
+ * with two random draws and generate_random_sequence walks the compact
+ * copy. Adding states or counters to the chain afterwards drops the copy,
+ * and it goes back to the linked structure until it is frozen again.
+ * @param markov_chain the chain to freeze
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error (the chain stays unfrozen).
+ */
+bool freeze_markov_chain (MarkovChain *markov_chain);
+
 /**
  * Free markov_chain and all of it's content from memory
  * @param markov_chain markov_chain to free
@@ -116,6 +319,21 @@ void free_markov_chain(MarkovChain **markov_chain);
 bool add_node_to_counter_list(MarkovNode *first_node, MarkovNode
 *second_node, MarkovChain *markov_chain);
 
+/**
+ * Like add_node_to_counter_list, but count second_node frequency times.
+ * @param first_node
+ * @param second_node
+ * @param markov_chain
+ * @param frequency number of times to count second_node, positive. The
+ *        frequency of an entry saturates at UINT32_MAX.
+ * @return success/failure: true if the process was successful, false if in
+ * case of allocation error.
+ */
+bool add_counts_to_counter_list (MarkovNode *first_node,
+                                 MarkovNode *second_node,
+                                 MarkovChain *markov_chain,
+                                 uint32_t frequency);
+
 /**
  * Check if data_ptr is in database. If so, return the markov_node wrapping
  * it in the markov_chain, otherwise return NULL.
@@ -135,4 +353,31 @@ Node* get_node_from_database(MarkovChain *markov_chain, void *data_ptr);
  */
 Node* add_to_database(MarkovChain *markov_chain, void *data_ptr);
 
+/**
+ * Add data_ptr to the end of markov_chain's database, without looking for
+ * it first: like add_to_database when data_ptr is not in the database.
+ * For lookups made outside of markov_chain.c, see markov_chain_specialize.h.
+ * @param markov_chain the chain to add to
+ * @param data_ptr the state to add, which must not be in the database
+ * @param hash hash_func (data_ptr), ignored if the chain has no hash_func
+ * @return markov_node wrapping a copy of data_ptr, NULL in case of
+ * allocation error (markov_chain is freed, like in add_to_database).
+ */
+Node *add_new_to_database (MarkovChain *markov_chain, void *data_ptr,
+                           unsigned long hash);
+
+/**
+ * Add every state and counter of source to markov_chain, as if the input
+ * source was built from were added to markov_chain after its own input:
+ * new states are added in source's order, and counters are added to (or
+ * appended to the counter lists of) markov_chain in source's order.
+ * The data of source's states is passed to add_to_database as data_ptr, so
+ * it must be a valid lookup key for markov_chain (see comp_func).
+ * @param markov_chain the chain to add to
+ * @param source the chain to add, left untouched
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+bool merge_markov_chain (MarkovChain *markov_chain, MarkovChain *source);
+
 #endif /* MARKOV_CHAIN_H */
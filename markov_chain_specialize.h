@@ -0,0 +1,74 @@
+#ifndef _MARKOV_CHAIN_SPECIALIZE_H_
+#define _MARKOV_CHAIN_SPECIALIZE_H_
+#include "markov_chain.h"
+#include "markov_stats.h"
+
+/**
+ * Define database lookups specialized for a concrete data type, that hash
+ * and compare with static inline functions instead of calling hash_func
+ * and comp_func through their pointers, so the compiler can inline them
+ * into the probing loop. Defines, for a prefix:
+ *
+ *   static inline Node *prefix##_get_node_from_database (
+ *       MarkovChain *markov_chain, const key_type *key);
+ *   static inline Node *prefix##_add_to_database (
+ *       MarkovChain *markov_chain, const key_type *key);
+ *
+ * which behave like get_node_from_database and add_to_database, so they may
+ * be mixed with the generic void* API on the same chain. The chain must
+ * have a hash_func that hashes like hash_key, and a comp_func that compares
+ * like compare_key. New states are still added with copy_func and is_last,
+ * once each.
+ *
+ * @param prefix prefix of the defined functions
+ * @param data_type the type of the data the chain stores
+ * @param key_type the type the chain is looked up by (may be data_type)
+ * @param hash_key unsigned long hash_key (const key_type *key)
+ * @param compare_key int compare_key (const data_type *data,
+ *        const key_type *key), 0 if they are equal
+ */
+#define DEFINE_SPECIALIZED_CHAIN(prefix, data_type, key_type, hash_key, \
+                                 compare_key)                           \
+static inline Node *prefix##_find_in_index (MarkovChain *markov_chain,  \
+                                            const key_type *key,        \
+                                            unsigned long hash)         \
+{                                                                       \
+  StateIndex *index = &markov_chain->index;                             \
+  COUNT_STAT (lookups, 1);                                              \
+  if (index->capacity == 0)                                             \
+    {                                                                   \
+      return NULL;                                                      \
+    }                                                                   \
+  size_t mask = index->capacity - 1;                                    \
+  for (size_t i = hash & mask; index->slots[i]; i = (i + 1) & mask)     \
+    {                                                                   \
+      if (index->hashes[i] != hash)                                     \
+        {                                                               \
+          continue;                                                     \
+        }                                                               \
+      COUNT_STAT (comparisons, 1);                                      \
+      if (compare_key ((const data_type *) index->slots[i]->data->data, \
+                       key) == 0)                                       \
+        {                                                               \
+          return index->slots[i];                                       \
+        }                                                               \
+    }                                                                   \
+  return NULL;                                                          \
+}                                                                       \
+                                                                        \
+static inline Node *prefix##_get_node_from_database (                   \
+    MarkovChain *markov_chain, const key_type *key)                     \
+{                                                                       \
+  return prefix##_find_in_index (markov_chain, key, hash_key (key));    \
+}                                                                       \
+                                                                        \
+static inline Node *prefix##_add_to_database (MarkovChain *markov_chain,\
+                                              const key_type *key)      \
+{                                                                       \
+  unsigned long hash = hash_key (key);                                  \
+  Node *node = prefix##_find_in_index (markov_chain, key, hash);        \
+  return node ? node : add_new_to_database (markov_chain, (void *) key, \
+                                            hash);                      \
+}
+
+#endif /* _MARKOV_CHAIN_SPECIALIZE_H_ */
@@ -0,0 +1,280 @@
+#include "markov_simulator.h"
+#include <pthread.h>
+
+#define WALKERS_PER_BATCH 512
+#define WALKS_PER_CHUNK 16384
+
+/**
+ * A batch of walkers, as a structure of arrays: walker i is in state[i],
+ * took steps[i] steps so far, and draws from rngs[i].
+ */
+typedef struct Walkers {
+    uint32_t state[WALKERS_PER_BATCH];
+    uint32_t steps[WALKERS_PER_BATCH];
+    Rng rngs[WALKERS_PER_BATCH];
+} Walkers;
+
+typedef struct Simulation {
+    const FrozenChain *frozen_chain;
+    uint32_t first_state;
+    uint64_t walks_num;
+    int max_steps;
+    uint64_t seed;
+
+    // absorbing[i] is 1 iff walks end at state i
+    uint8_t *absorbing;
+
+    // guards next_walk, result and failed
+    pthread_mutex_t lock;
+    uint64_t next_walk;
+    SimulationResult *result;
+    bool failed;
+} Simulation;
+
+/**
+ * Start walk number walk on walker i.
+ */
+static void start_walk (Simulation *simulation, Walkers *walkers, int i,
+                        uint64_t walk, uint64_t *visits)
+{
+  walkers->state[i] = simulation->first_state;
+  walkers->steps[i] = 0;
+  seed_rng (&walkers->rngs[i], simulation->seed, walk);
+  visits[simulation->first_state]++;
+}
+
+/**
+ * Walk the walks begin to end - 1, WALKERS_PER_BATCH at a time, into the
+ * statistics of local.
+ */
+static void run_walks (Simulation *simulation, Walkers *walkers,
+                       uint64_t begin, uint64_t end,
+                       SimulationResult *local)
+{
+  const FrozenChain *frozen_chain = simulation->frozen_chain;
+  const uint32_t *offsets = frozen_chain->offsets;
+  const uint32_t *successors = frozen_chain->successors;
+  const AliasEntry *alias_table = frozen_chain->alias_table;
+  const uint32_t *weight_sums = frozen_chain->weight_sums;
+  const uint8_t *absorbing = simulation->absorbing;
+  uint32_t max_steps = (uint32_t) simulation->max_steps;
+  uint64_t *visits = local->visits;
+
+  uint64_t next_walk = begin;
+  int active = 0;
+  while (active < WALKERS_PER_BATCH && next_walk < end)
+    {
+      start_walk (simulation, walkers, active++, next_walk++, visits);
+    }
+  while (active > 0)
+    {
+      // every active walker takes a step
+      for (int i = 0; i < active; ++i)
+        {
+          uint32_t state = walkers->state[i];
+          uint32_t offset = offsets[state];
+          Rng *rng = &walkers->rngs[i];
+          uint32_t column = get_bounded_random (rng,
+                                                offsets[state + 1] - offset);
+          uint32_t coin = get_bounded_random (rng, weight_sums[state]);
+          const AliasEntry *entry = alias_table + offset + column;
+          if (coin >= (uint32_t) entry->threshold)
+            {
+              column = (uint32_t) entry->alias;
+            }
+          state = successors[offset + column];
+          walkers->state[i] = state;
+          walkers->steps[i]++;
+          visits[state]++;
+        }
+      local->transitions += (uint64_t) active;
+
+      // the walkers that ended take the next walks, or leave the batch
+      for (int i = 0; i < active;)
+        {
+          uint32_t steps = walkers->steps[i];
+          bool ended = absorbing[walkers->state[i]];
+          if (!ended && steps < max_steps)
+            {
+              ++i;
+              continue;
+            }
+          if (ended)
+            {
+              local->lengths[steps]++;
+            }
+          else
+            {
+              local->unfinished++;
+            }
+          if (next_walk < end)
+            {
+              start_walk (simulation, walkers, i++, next_walk++, visits);
+            }
+          else
+            {
+              active--;
+              walkers->state[i] = walkers->state[active];
+              walkers->steps[i] = walkers->steps[active];
+              walkers->rngs[i] = walkers->rngs[active];
+            }
+        }
+    }
+}
+
+/**
+ * Allocate the arrays of result, zeroed.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool init_simulation_result (SimulationResult *result,
+                                    uint32_t states_length, int max_steps)
+{
+  *result = (SimulationResult) {0};
+  result->max_steps = max_steps;
+  result->lengths = calloc ((size_t) max_steps + 1, sizeof (uint64_t));
+  result->visits = calloc ((size_t) states_length + 1, sizeof (uint64_t));
+  if (!result->lengths || !result->visits)
+    {
+      free_simulation_result (result);
+      return false;
+    }
+  return true;
+}
+
+/**
+ * A thread's routine: take chunks of walks until there are none left, and
+ * add their statistics to the simulation's result.
+ * @param arg the Simulation
+ * @return NULL
+ */
+static void *run_simulation (void *arg)
+{
+  Simulation *simulation = arg;
+  SimulationResult local;
+  Walkers *walkers = malloc (sizeof (Walkers));
+  if (!walkers
+      || !init_simulation_result (&local,
+                                  simulation->frozen_chain->states_length,
+                                  simulation->max_steps))
+    {
+      free (walkers);
+      pthread_mutex_lock (&simulation->lock);
+      simulation->failed = true;
+      pthread_mutex_unlock (&simulation->lock);
+      return NULL;
+    }
+  while (true)
+    {
+      pthread_mutex_lock (&simulation->lock);
+      uint64_t begin = simulation->next_walk;
+      uint64_t end = simulation->walks_num - begin < WALKS_PER_CHUNK
+                     ? simulation->walks_num : begin + WALKS_PER_CHUNK;
+      simulation->next_walk = end;
+      pthread_mutex_unlock (&simulation->lock);
+      if (begin == end)
+        {
+          break;
+        }
+      run_walks (simulation, walkers, begin, end, &local);
+      local.walks += end - begin;
+    }
+
+  pthread_mutex_lock (&simulation->lock);
+  SimulationResult *result = simulation->result;
+  for (int k = 0; k <= result->max_steps; ++k)
+    {
+      result->lengths[k] += local.lengths[k];
+    }
+  for (uint32_t i = 0; i < simulation->frozen_chain->states_length; ++i)
+    {
+      result->visits[i] += local.visits[i];
+    }
+  result->walks += local.walks;
+  result->unfinished += local.unfinished;
+  result->transitions += local.transitions;
+  pthread_mutex_unlock (&simulation->lock);
+  free_simulation_result (&local);
+  free (walkers);
+  return NULL;
+}
+
+bool simulate_frozen_chain (const FrozenChain *frozen_chain,
+                            uint32_t first_state,
+                            uint64_t walks_num,
+                            int max_steps,
+                            uint64_t seed,
+                            int threads,
+                            SimulationResult *result)
+{
+  // every walk takes a step before its length is checked
+  if (max_steps < 1)
+    {
+      return false;
+    }
+  uint32_t states_length = frozen_chain->states_length;
+  Simulation simulation = {frozen_chain, first_state, walks_num, max_steps,
+                           seed, NULL, PTHREAD_MUTEX_INITIALIZER, 0, result,
+                           false};
+  simulation.absorbing = malloc ((size_t) states_length + 1);
+  threads = threads < 1 ? 1 : threads;
+  pthread_t *pool = malloc (threads * sizeof (pthread_t));
+  if (!simulation.absorbing || !pool
+      || !init_simulation_result (result, states_length, max_steps))
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (simulation.absorbing);
+      free (pool);
+      return false;
+    }
+  for (uint32_t i = 0; i < states_length; ++i)
+    {
+      simulation.absorbing[i] = is_last_frozen_state (frozen_chain, i)
+                                || frozen_chain->offsets[i]
+                                   == frozen_chain->offsets[i + 1];
+    }
+
+  if (simulation.absorbing[first_state])
+    {
+      // every walk ends where it starts
+      result->lengths[0] = result->walks = walks_num;
+      result->visits[first_state] = walks_num;
+      simulation.next_walk = walks_num;
+    }
+  int started = 0;
+  for (int i = 0; i < threads; ++i)
+    {
+      if (pthread_create (&pool[started], NULL, run_simulation,
+                          &simulation) == 0)
+        {
+          started++;
+        }
+    }
+  if (started == 0)
+    {
+      run_simulation (&simulation);
+    }
+  for (int i = 0; i < started; ++i)
+    {
+      pthread_join (pool[i], NULL);
+    }
+
+  pthread_mutex_destroy (&simulation.lock);
+  free (simulation.absorbing);
+  free (pool);
+  if (simulation.failed)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free_simulation_result (result);
+      return false;
+    }
+  return true;
+}
+
+void free_simulation_result (SimulationResult *result)
+{
+  free (result->lengths);
+  free (result->visits);
+  result->lengths = NULL;
+  result->visits = NULL;
+}
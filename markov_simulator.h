@@ -0,0 +1,60 @@
+#ifndef _MARKOV_SIMULATOR_H_
+#define _MARKOV_SIMULATOR_H_
+#include "frozen_chain.h"
+
+/**
+ * Aggregate statistics of many random walks over a FrozenChain, see
+ * simulate_frozen_chain. A walk ends at a last state or at a state without
+ * successors, like in generate_frozen_sequence, and its length is its
+ * number of steps (transitions).
+ */
+typedef struct SimulationResult {
+    // lengths[k] is the number of walks that ended after exactly k steps,
+    // for k up to max_steps
+    uint64_t *lengths;
+    int max_steps;
+
+    // visits[i] is the number of times walks were in state i (counting
+    // the first state of every walk)
+    uint64_t *visits;
+
+    uint64_t walks;
+    // walks that didn't end within max_steps steps
+    uint64_t unfinished;
+    uint64_t transitions;
+} SimulationResult;
+
+/**
+ * Walk walks_num random walks from first_state, without output, and
+ * collect their statistics. The walkers advance in batches kept as a
+ * structure of arrays (the state, length and random generator of every
+ * walker in arrays of their own), on a pool of threads. Walk i draws from
+ * stream i of seed, so the result only depends on the seed, not on the
+ * number of threads.
+ * @param frozen_chain the chain to walk, read only
+ * @param first_state id of the state every walk starts at
+ * @param walks_num number of walks
+ * @param max_steps maximal number of steps of a walk, at least 1
+ * @param seed the seed of the random streams
+ * @param threads number of threads to walk on
+ * @param result filled with the statistics, free with
+ *        free_simulation_result
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error or if max_steps is less than 1 (result is left
+ * untouched then).
+ */
+bool simulate_frozen_chain (const FrozenChain *frozen_chain,
+                            uint32_t first_state,
+                            uint64_t walks_num,
+                            int max_steps,
+                            uint64_t seed,
+                            int threads,
+                            SimulationResult *result);
+
+/**
+ * Free the arrays of result.
+ * @param result the result to free
+ */
+void free_simulation_result (SimulationResult *result);
+
+#endif /* _MARKOV_SIMULATOR_H_ */
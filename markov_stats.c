@@ -0,0 +1,105 @@
+#define _POSIX_C_SOURCE 199309L // For clock_gettime()
+
+#include "markov_stats.h"
+
+#ifdef MARKOV_STATS
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#define NANOS_IN_SECOND 1e9
+
+__thread MarkovStats *thread_stats = NULL;
+
+// the counters of every thread that counted anything, which live until
+// the program exits (after the threads, so they can be summed)
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static MarkovStats *registry = NULL;
+
+// counted by threads whose own counters couldn't be allocated
+static MarkovStats fallback_stats;
+
+static double phase_seconds[PHASES_NUM];
+static double phase_starts[PHASES_NUM];
+static const char *phase_names[] = {"ingest", "generate", "free"};
+
+/**
+ * @return monotonic time in seconds
+ */
+static double get_time (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / NANOS_IN_SECOND;
+}
+
+MarkovStats *register_thread_stats (void)
+{
+  MarkovStats *stats = calloc (1, sizeof (MarkovStats));
+  if (!stats)
+    {
+      return &fallback_stats;
+    }
+  pthread_mutex_lock (&registry_lock);
+  stats->next = registry;
+  registry = stats;
+  pthread_mutex_unlock (&registry_lock);
+  thread_stats = stats;
+  return stats;
+}
+
+void start_stats_phase (StatsPhase phase)
+{
+  phase_starts[phase] = get_time ();
+}
+
+void end_stats_phase (StatsPhase phase)
+{
+  phase_seconds[phase] += get_time () - phase_starts[phase];
+}
+
+void print_markov_stats (FILE *stream)
+{
+  MarkovStats total = fallback_stats;
+  pthread_mutex_lock (&registry_lock);
+  for (MarkovStats *stats = registry; stats; stats = stats->next)
+    {
+      total.lookups += stats->lookups;
+      total.comparisons += stats->comparisons;
+      total.allocations += stats->allocations;
+      total.reallocations += stats->reallocations;
+      total.bytes_allocated += stats->bytes_allocated;
+      total.samples += stats->samples;
+      total.scans += stats->scans;
+      total.scan_steps += stats->scan_steps;
+    }
+  pthread_mutex_unlock (&registry_lock);
+
+  fprintf (stream, "{\"enabled\": true, \"lookups\": %lu, "
+                   "\"comparisons\": %lu, \"comparisons_per_lookup\": %.3f, "
+                   "\"allocations\": %lu, \"reallocations\": %lu, "
+                   "\"bytes_allocated\": %lu, \"samples\": %lu, "
+                   "\"scans\": %lu, \"average_scan_length\": %.3f, "
+                   "\"phases\": {",
+           total.lookups, total.comparisons,
+           total.lookups ? (double) total.comparisons / total.lookups : 0,
+           total.allocations, total.reallocations, total.bytes_allocated,
+           total.samples, total.scans,
+           total.scans ? (double) total.scan_steps / total.scans : 0);
+  for (int phase = 0; phase < PHASES_NUM; ++phase)
+    {
+      fprintf (stream, "%s\"%s\": %.6f", phase ? ", " : "",
+               phase_names[phase], phase_seconds[phase]);
+    }
+  fprintf (stream, "}}\n");
+}
+
+#else
+
+void print_markov_stats (FILE *stream)
+{
+  fprintf (stream, "{\"enabled\": false}\n");
+}
+
+#endif /* MARKOV_STATS */
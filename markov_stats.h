@@ -0,0 +1,90 @@
+#ifndef _MARKOV_STATS_H_
+#define _MARKOV_STATS_H_
+#include <stdio.h>
+
+/**
+ * Counters of the hot paths of markov_chain.c, and timers of the phases of
+ * a program, compiled in only if MARKOV_STATS is defined. Without it the
+ * counting macros expand to nothing, so they cost nothing.
+ */
+
+/**
+ * The phases of a program that uses a chain.
+ */
+typedef enum StatsPhase {
+    INGEST_PHASE,
+    GENERATE_PHASE,
+    FREE_PHASE,
+    PHASES_NUM
+} StatsPhase;
+
+/**
+ * The counters of a single thread.
+ */
+typedef struct MarkovStats {
+    // lookups of states, and the comp_func calls they took
+    unsigned long lookups;
+    unsigned long comparisons;
+    // malloc and calloc calls (and copy_func calls), realloc calls, and
+    // the bytes they asked for (but copy_func's), including the nodes out
+    // of the node arena
+    unsigned long allocations;
+    unsigned long reallocations;
+    unsigned long bytes_allocated;
+    // get_next_random_node calls, those that scanned the counter_list, and
+    // the entries they scanned
+    unsigned long samples;
+    unsigned long scans;
+    unsigned long scan_steps;
+    // the counters of the next thread, see register_thread_stats
+    struct MarkovStats *next;
+} MarkovStats;
+
+#ifdef MARKOV_STATS
+
+extern __thread MarkovStats *thread_stats;
+
+/**
+ * Allocate the counters of the calling thread, and register them so that
+ * print_markov_stats sums them with the others'.
+ * @return the counters, or a shared fallback in case of allocation error
+ */
+MarkovStats *register_thread_stats (void);
+
+/**
+ * @return the counters of the calling thread
+ */
+static inline MarkovStats *get_thread_stats (void)
+{
+  return thread_stats ? thread_stats : register_thread_stats ();
+}
+
+#define COUNT_STAT(field, amount) (get_thread_stats ()->field += (amount))
+
+/**
+ * Start timing phase. Its wall time adds up over all of its runs.
+ */
+void start_stats_phase (StatsPhase phase);
+
+/**
+ * Stop timing phase.
+ */
+void end_stats_phase (StatsPhase phase);
+
+#else
+
+#define COUNT_STAT(field, amount) ((void) 0)
+#define start_stats_phase(phase) ((void) 0)
+#define end_stats_phase(phase) ((void) 0)
+
+#endif /* MARKOV_STATS */
+
+/**
+ * Print the counters of all the threads, summed, and the time of every
+ * phase, as a JSON object. Prints {"enabled": false} if the program was
+ * built without MARKOV_STATS.
+ * @param stream where to print to
+ */
+void print_markov_stats (FILE *stream);
+
+#endif /* _MARKOV_STATS_H_ */
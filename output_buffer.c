@@ -0,0 +1,138 @@
+#define _POSIX_C_SOURCE 200112L // For write()
+
+#include "output_buffer.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUMBER_TEXT_SIZE 24
+#define DECIMAL_BASE 10
+
+void init_output_buffer (OutputBuffer *buffer, int fd)
+{
+  *buffer = (OutputBuffer) {NULL, 0, 0, fd, false};
+}
+
+/**
+ * Make sure the buffer has room for size more bytes, doubling its capacity
+ * if not.
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool reserve_output (OutputBuffer *buffer, size_t size)
+{
+  size_t needed = buffer->length + size;
+  if (needed <= buffer->capacity)
+    {
+      return true;
+    }
+  size_t capacity = buffer->capacity ? buffer->capacity : OUTPUT_FLUSH_SIZE;
+  while (capacity < needed)
+    {
+      capacity *= 2;
+    }
+  char *data = realloc (buffer->data, capacity);
+  if (!data)
+    {
+      buffer->failed = true;
+      return false;
+    }
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return true;
+}
+
+/**
+ * Flush the buffer if it got full enough.
+ */
+static bool end_append (OutputBuffer *buffer)
+{
+  if (buffer->length >= OUTPUT_FLUSH_SIZE)
+    {
+      return flush_output_buffer (buffer);
+    }
+  return !buffer->failed;
+}
+
+bool append_to_output (OutputBuffer *buffer, const char *bytes, size_t size)
+{
+  if (!reserve_output (buffer, size))
+    {
+      return false;
+    }
+  memcpy (buffer->data + buffer->length, bytes, size);
+  buffer->length += size;
+  return end_append (buffer);
+}
+
+bool append_number_to_output (OutputBuffer *buffer, long number)
+{
+  char text[NUMBER_TEXT_SIZE];
+  char *start = text + NUMBER_TEXT_SIZE;
+  unsigned long value = number < 0 ? 0UL - (unsigned long) number
+                                   : (unsigned long) number;
+  do
+    {
+      *--start = (char) ('0' + value % DECIMAL_BASE);
+      value /= DECIMAL_BASE;
+    }
+  while (value > 0);
+  if (number < 0)
+    {
+      *--start = '-';
+    }
+  return append_to_output (buffer, start, text + NUMBER_TEXT_SIZE - start);
+}
+
+bool append_formatted_to_output (OutputBuffer *buffer,
+                                 format_data format_func,
+                                 void *data)
+{
+  size_t room = buffer->capacity - buffer->length;
+  size_t length = format_func (data, buffer->data ? buffer->data
+                                                    + buffer->length
+                                                  : NULL, room);
+  if (length > room)
+    {
+      // didn't fit, so make room and format it again
+      if (!reserve_output (buffer, length))
+        {
+          return false;
+        }
+      format_func (data, buffer->data + buffer->length, length);
+    }
+  buffer->length += length;
+  return end_append (buffer);
+}
+
+bool flush_output_buffer (OutputBuffer *buffer)
+{
+  if (buffer->fd == STDOUT_FILENO)
+    {
+      fflush (stdout);
+    }
+  size_t written = 0;
+  while (!buffer->failed && written < buffer->length)
+    {
+      ssize_t result = write (buffer->fd, buffer->data + written,
+                              buffer->length - written);
+      if (result < 0 && errno != EINTR)
+        {
+          buffer->failed = true;
+        }
+      else if (result > 0)
+        {
+          written += (size_t) result;
+        }
+    }
+  buffer->length = 0;
+  return !buffer->failed;
+}
+
+void free_output_buffer (OutputBuffer *buffer)
+{
+  free (buffer->data);
+  init_output_buffer (buffer, buffer->fd);
+}
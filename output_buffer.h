@@ -0,0 +1,78 @@
+#ifndef _OUTPUT_BUFFER_H_
+#define _OUTPUT_BUFFER_H_
+#include <stdbool.h> // for bool
+#include <stddef.h> // For size_t
+
+#define OUTPUT_FLUSH_SIZE 65536
+
+// pointer to a func that gets a pointer of generic data type, and writes
+// its text to dest, up to size bytes (no terminating null is needed).
+// dest may be NULL if size is 0.
+// returns the full length of the text, which may be more than size.
+typedef size_t (*format_data)(void*, char*, size_t);
+
+/**
+ * A growable buffer of output bytes, written to a file descriptor with
+ * large write calls: appending flushes the buffer once it holds
+ * OUTPUT_FLUSH_SIZE bytes. A zero initialized OutputBuffer is empty, with
+ * fd 0, so use init_output_buffer.
+ */
+typedef struct OutputBuffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int fd;
+    // whether an allocation or a write failed, see flush_output_buffer
+    bool failed;
+} OutputBuffer;
+
+/**
+ * Make an empty buffer that writes to fd.
+ * @param buffer the buffer to initialize
+ * @param fd file descriptor to write to
+ */
+void init_output_buffer (OutputBuffer *buffer, int fd);
+
+/**
+ * Append size bytes to the buffer.
+ * @param buffer the buffer to append to
+ * @param bytes the bytes to append
+ * @param size number of bytes
+ * @return success/failure: true if the process was successful, false in
+ * case of an allocation or IO error.
+ */
+bool append_to_output (OutputBuffer *buffer, const char *bytes, size_t size);
+
+/**
+ * Append the decimal text of number to the buffer.
+ * @return success/failure, like append_to_output.
+ */
+bool append_number_to_output (OutputBuffer *buffer, long number);
+
+/**
+ * Append the text of data, formatted straight into the buffer.
+ * @param buffer the buffer to append to
+ * @param format_func writes the text of data
+ * @param data the data to format
+ * @return success/failure, like append_to_output.
+ */
+bool append_formatted_to_output (OutputBuffer *buffer,
+                                 format_data format_func,
+                                 void *data);
+
+/**
+ * Write everything in the buffer to its fd. When that is stdout, stdout's
+ * stdio buffer is flushed first, so output printed before stays in order.
+ * @param buffer the buffer to flush
+ * @return success/failure: true if the process was successful, false if
+ * any append or write to the buffer failed so far.
+ */
+bool flush_output_buffer (OutputBuffer *buffer);
+
+/**
+ * Free the memory of the buffer (without flushing it).
+ * @param buffer the buffer to free
+ */
+void free_output_buffer (OutputBuffer *buffer);
+
+#endif /* _OUTPUT_BUFFER_H_ */
@@ -0,0 +1,31 @@
+#include "rng.h"
+
+#define SPLITMIX_INCREMENT 0x9E3779B97F4A7C15ULL
+#define SPLITMIX_MULTIPLIER1 0xBF58476D1CE4E5B9ULL
+#define SPLITMIX_MULTIPLIER2 0x94D049BB133111EBULL
+#define STREAM_MULTIPLIER 0xD1342543DE82EF95ULL
+
+/**
+ * Advance a splitmix64 generator, used to expand a seed into a full state.
+ * @param x the splitmix64 state
+ * @return the next 64 bits
+ */
+static uint64_t get_next_splitmix (uint64_t *x)
+{
+  uint64_t z = (*x += SPLITMIX_INCREMENT);
+  z = (z ^ (z >> 30)) * SPLITMIX_MULTIPLIER1;
+  z = (z ^ (z >> 27)) * SPLITMIX_MULTIPLIER2;
+  return z ^ (z >> 31);
+}
+
+void seed_rng (Rng *rng, uint64_t seed, uint64_t stream)
+{
+  // mix the stream in before expanding, so that nearby seeds and streams
+  // don't start from nearby splitmix states
+  uint64_t mixed_stream = stream * STREAM_MULTIPLIER;
+  uint64_t x = get_next_splitmix (&seed) ^ get_next_splitmix (&mixed_stream);
+  for (int i = 0; i < 4; ++i)
+    {
+      rng->state[i] = get_next_splitmix (&x);
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef _RNG_H_
+#define _RNG_H_
+#include <stdint.h>
+
+#define RNG_BITS_IN_WORD 64
+#define RNG_BITS_IN_HALF 32
+
+/**
+ * State of a xoshiro256** pseudo random number generator. Every Rng is an
+ * independent stream, so threads that each own one don't share any state.
+ */
+typedef struct Rng {
+    uint64_t state[4];
+} Rng;
+
+/**
+ * Seed rng as stream number stream of seed: the same seed and stream
+ * always give the same sequence, and different streams of a seed give
+ * independent looking ones.
+ * @param rng the generator to seed
+ * @param seed the seed (e.g. the one from the command line)
+ * @param stream number of the stream
+ */
+void seed_rng (Rng *rng, uint64_t seed, uint64_t stream);
+
+static inline uint64_t rotate_bits_left (uint64_t x, int k)
+{
+  return (x << k) | (x >> (RNG_BITS_IN_WORD - k));
+}
+
+/**
+ * @param rng the generator to advance
+ * @return the next 64 random bits of rng
+ */
+static inline uint64_t get_next_random (Rng *rng)
+{
+  uint64_t *s = rng->state;
+  uint64_t result = rotate_bits_left (s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotate_bits_left (s[3], 45);
+  return result;
+}
+
+/**
+ * Get an unbiased random number in [0, bound), by multiplying and
+ * rejecting the few values that would make some results more likely
+ * (Lemire's method).
+ * @param rng the generator to advance
+ * @param bound maximal number to return (not including), must be positive
+ * @return random number
+ */
+static inline uint32_t get_bounded_random (Rng *rng, uint32_t bound)
+{
+  uint64_t product = (get_next_random (rng) >> RNG_BITS_IN_HALF) * bound;
+  uint32_t low = (uint32_t) product;
+  if (low < bound)
+    {
+      // values below threshold would appear once more than the others
+      uint32_t threshold = -bound % bound;
+      while (low < threshold)
+        {
+          product = (get_next_random (rng) >> RNG_BITS_IN_HALF) * bound;
+          low = (uint32_t) product;
+        }
+    }
+  return (uint32_t) (product >> RNG_BITS_IN_HALF);
+}
+
+/**
+ * Like get_bounded_random, for bounds that may not fit in 32 bits: the
+ * same numbers as get_bounded_random if bound does, and rejects the values
+ * of the last incomplete range of bound otherwise.
+ * @param rng the generator to advance
+ * @param bound maximal number to return (not including), must be positive
+ * @return random number
+ */
+static inline uint64_t get_wide_bounded_random (Rng *rng, uint64_t bound)
+{
+  if (bound <= UINT32_MAX)
+    {
+      return get_bounded_random (rng, (uint32_t) bound);
+    }
+  // values from threshold on would appear once more than the others
+  uint64_t threshold = UINT64_MAX - UINT64_MAX % bound;
+  uint64_t value = get_next_random (rng);
+  while (value >= threshold)
+    {
+      value = get_next_random (rng);
+    }
+  return value % bound;
+}
+
+#endif /* _RNG_H_ */
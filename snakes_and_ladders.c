@@ -1,5 +1,12 @@
+#define _POSIX_C_SOURCE 200112L // For clock_gettime(), sysconf()
+
 #include <string.h> // For strlen(), strcmp(), strcpy()
+#include <time.h>
+#include <unistd.h> // For STDOUT_FILENO
 #include "markov_chain.h"
+#include "markov_analytics.h"
+#include "markov_simulator.h"
+#include "markov_stats.h"
 
 #define MAX(X, Y) (((X) < (Y)) ? (Y) : (X))
 
@@ -10,9 +17,27 @@
 #define DICE_MAX 6
 #define NUM_OF_TRANSITIONS 20
 
+#define MIN_BOARD_SIZE 2
+#define TRANSITION_CELLS 10
+#define BOARD_STREAM 1
+
 #define DECIMAL_BASE 10
 #define ARGS_NUM 3
+#define ANALYZE_FLAG "--analyze"
+#define SIMULATE_FLAG "--simulate"
+#define POSITION_FLAG "--position"
+#define BOARD_FLAG "--board"
+#define RANDOM_BOARD_FLAG "--random-board"
+#define STATS_FLAG "--stats"
+#define SIMULATION_MAX_STEPS 10000
+#define NANOS_IN_SECOND 1e9
+#define ANALYSIS_MAX_STEPS 1000
+#define ANALYSIS_COVERAGE 0.9999
 #define USAGE_ERR_MSG "USAGE: Incorrect num of arguments"
+#define BOARD_ERR_MSG "ERROR: The given board is invalid.\n"
+#define CELL_TEXT_SIZE 64
+#define ROUTE_PREFIX "Random Walk "
+#define ROUTE_SEPARATOR ": "
 
 /**
  * represents the transitions by ladders and snakes in the game
@@ -54,73 +79,166 @@ typedef struct Cell {
     //both ladder_to and snake_to should be -1 if the Cell doesn't have them
 } Cell;
 
+/**
+ * The board of the game: size cells, numbered 1 to size, and a dice of
+ * dice_max faces.
+ */
+typedef struct Board {
+    int size;
+    int dice_max;
+    Cell *cells;
+} Board;
+
+/**
+ * The optional command line arguments.
+ */
+typedef struct Options {
+    bool analyze;
+    bool simulate;
+    // number of steps to print the position after, -1 if not requested
+    int position_steps;
+    char *board_path;
+    int random_board_size;
+    // print the stats of markov_stats.h to stderr at the end
+    bool stats;
+} Options;
+
+// the size of the board being played, see is_last_cell
+static int board_size = BOARD_SIZE;
+
 // functions for generic implementation
 static void print_cell (void *data);
+static size_t format_cell (void *data, char *dest, size_t size);
 static int compare_cells (void *ptr1, void *ptr2);
 static void free_cell (void *data);
 static void *copy_cell (void *ptr);
 static bool is_last_cell (void *ptr);
+static unsigned long hash_cell (void *ptr);
 
 // supplied functions
 static int handle_error (char *error_msg, MarkovChain **database);
-static int create_board (Cell *cells[BOARD_SIZE]);
-static int fill_database (MarkovChain *markov_chain);
+static int create_board (Board *board, const Options *options,
+                         uint64_t seed);
+static int fill_database (MarkovChain *markov_chain, const Board *board);
+static int parse_options (int argc, char *argv[], Options *options);
 
 // helpers
 static int get_num_from_str (char *str);
 static MarkovChain *get_markov_chain ();
-static void generate_routes (MarkovChain *markov_chain,
+static bool generate_routes (MarkovChain *markov_chain,
                              int routes_num,
-                             int routes_size);
+                             int routes_size,
+                             Rng *rng);
+static bool analyze_game (MarkovChain *markov_chain);
+static bool print_position (MarkovChain *markov_chain, int steps);
+static bool simulate_games (MarkovChain *markov_chain, uint64_t seed,
+                            int games_num);
 
 /**
  * @param argc num of arguments
  * @param argv 1) Seed
  *             2) Number of sentences to generate
+ *             3) Options (optional):
+ *                "--analyze": instead of generating routes, print the
+ *                exact expected number of steps to finish from every cell,
+ *                and the distribution of steps from cell 1
+ *                "--simulate": instead of printing routes, simulate that
+ *                many games and print their statistics
+ *                "--board <file>": play the board in the file (see
+ *                read_board) instead of the classic one
+ *                "--random-board <cells>": play a board of that many cells
+ *                generated from the seed (see generate_board)
+ *                "--stats": print the stats of markov_stats.h to stderr
+ *                at the end
  * @return EXIT_SUCCESS or EXIT_FAILURE
  */
 int main (int argc, char *argv[])
 {
-  if (argc != ARGS_NUM)
+  Options options;
+  if (parse_options (argc, argv, &options) != EXIT_SUCCESS)
     {
-      fprintf (stdout, USAGE_ERR_MSG);
       return EXIT_FAILURE;
     }
 
-  // Set seed for rand
-  srand ((int) get_num_from_str (argv[1]));
+  // Set seed for the routes' random stream
+  uint64_t seed = (uint64_t) get_num_from_str (argv[1]);
+  Rng rng;
+  seed_rng (&rng, seed, 0);
   int routes_num = get_num_from_str (argv[2]);
+  start_stats_phase (INGEST_PHASE);
+  Board board;
+  if (create_board (&board, &options, seed) != EXIT_SUCCESS)
+    {
+      return EXIT_FAILURE;
+    }
+  board_size = board.size;
   MarkovChain *markov_chain = get_markov_chain ();
-  if (!markov_chain)
+  if (!markov_chain || fill_database (markov_chain, &board) != EXIT_SUCCESS)
     {
+      // fill_database may only fail on allocation errors, which leave the
+      // process anyway
+      free (board.cells);
       return EXIT_FAILURE;
     }
-
-  fill_database (markov_chain);
-  generate_routes (markov_chain, routes_num, MAX_GENERATION_LENGTH);
+  free (board.cells);
+  if (!freeze_markov_chain (markov_chain))
+    {
+      free_markov_chain (&markov_chain);
+      return EXIT_FAILURE;
+    }
+  end_stats_phase (INGEST_PHASE);
+  start_stats_phase (GENERATE_PHASE);
+  bool success = options.analyze ? analyze_game (markov_chain)
+                 : options.position_steps >= 0
+                   ? print_position (markov_chain, options.position_steps)
+                 : options.simulate ? simulate_games (markov_chain, seed,
+                                                      routes_num)
+                 : generate_routes (markov_chain, routes_num,
+                                    MAX_GENERATION_LENGTH, &rng);
+  end_stats_phase (GENERATE_PHASE);
+  start_stats_phase (FREE_PHASE);
   free_markov_chain (&markov_chain);
+  end_stats_phase (FREE_PHASE);
+  if (options.stats)
+    {
+      print_markov_stats (stderr);
+    }
 
-  return EXIT_SUCCESS;
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 // functions for generic implementation
 // print
 static void print_cell (void *data)
+{
+  char text[CELL_TEXT_SIZE];
+  size_t length = format_cell (data, text, CELL_TEXT_SIZE);
+  fwrite (text, 1, length, stdout);
+}
+
+// format
+static size_t format_cell (void *data, char *dest, size_t size)
 {
   Cell *cell = (Cell *) data;
-  printf ("[%d]", cell->number);
+  char text[CELL_TEXT_SIZE];
+  int length = sprintf (text, "[%d]", cell->number);
   if (cell->snake_to != EMPTY)
     {
-      printf ("-snake to %d", cell->snake_to);
+      length += sprintf (text + length, "-snake to %d", cell->snake_to);
     }
   if (cell->ladder_to != EMPTY)
     {
-      printf ("-ladder to %d", cell->ladder_to);
+      length += sprintf (text + length, "-ladder to %d", cell->ladder_to);
     }
   if (!is_last_cell(data))
     {
-      printf(" -> ");
+      length += sprintf (text + length, " -> ");
+    }
+  if ((size_t) length <= size)
+    {
+      memcpy (dest, text, length);
     }
+  return length;
 }
 
 // compare
@@ -156,13 +274,19 @@ static void *copy_cell (void *ptr)
 // is last
 static bool is_last_cell (void *ptr)
 {
-  if (((Cell *) ptr)->number == BOARD_SIZE)
+  if (((Cell *) ptr)->number == board_size)
     {
       return true;
     }
   return false;
 }
 
+// hash
+static unsigned long hash_cell (void *ptr)
+{
+  return (unsigned long) ((Cell *) ptr)->number;
+}
+
 
 // supplied functions
 /** Error handler **/
@@ -176,88 +300,376 @@ static int handle_error (char *error_msg, MarkovChain **database)
   return EXIT_FAILURE;
 }
 
-static int create_board (Cell *cells[BOARD_SIZE])
+/**
+ * Put a ladder (from < to) or a snake (from > to) on the board.
+ */
+static void add_transition (Board *board, int from, int to)
+{
+  if (from < to)
+    {
+      board->cells[from - 1].ladder_to = to;
+    }
+  else
+    {
+      board->cells[from - 1].snake_to = to;
+    }
+}
+
+/**
+ * @return true if the cell has a ladder or a snake.
+ */
+static bool has_transition (const Cell *cell)
 {
-  for (int i = 0; i < BOARD_SIZE; i++)
+  return cell->ladder_to != EMPTY || cell->snake_to != EMPTY;
+}
+
+/**
+ * Find the cells a game can finish from, with a breadth first search from
+ * the last cell over the moves of fill_database, backwards.
+ * @return an array of a flag for every cell, NULL in case of allocation
+ * error.
+ */
+static bool *find_finishing_cells (const Board *board)
+{
+  int size = board->size;
+  bool *finishing = calloc ((size_t) size, sizeof (bool));
+  int *queue = malloc ((size_t) size * sizeof (int));
+  // the cells with a ladder or a snake to cell i are sources[offsets[i]]
+  // to sources[offsets[i + 1] - 1]
+  int *offsets = calloc ((size_t) size + 1, sizeof (int));
+  int *sources = malloc ((size_t) size * sizeof (int));
+  if (!finishing || !queue || !offsets || !sources)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free (finishing);
+      free (queue);
+      free (offsets);
+      free (sources);
+      return NULL;
+    }
+  for (int i = 0; i < size; i++)
+    {
+      const Cell *cell = &board->cells[i];
+      if (has_transition (cell))
+        {
+          offsets[MAX(cell->snake_to, cell->ladder_to)]++;
+        }
+    }
+  for (int i = 0; i < size; i++)
+    {
+      offsets[i + 1] += offsets[i];
+    }
+  for (int i = 0; i < size; i++)
     {
-      cells[i] = malloc (sizeof (Cell));
-      if (cells[i] == NULL)
+      const Cell *cell = &board->cells[i];
+      if (has_transition (cell))
         {
-          for (int j = 0; j < i; j++)
+          sources[offsets[MAX(cell->snake_to, cell->ladder_to) - 1]++] = i;
+        }
+    }
+  // every offsets[i] moved to offsets[i + 1], move them back
+  for (int i = size; i > 0; i--)
+    {
+      offsets[i] = offsets[i - 1];
+    }
+  offsets[0] = 0;
+
+  int head = 0, tail = 0;
+  finishing[size - 1] = true;
+  queue[tail++] = size - 1;
+  while (head < tail)
+    {
+      int cell = queue[head++];
+      for (int j = 1; j <= board->dice_max && cell - j >= 0; j++)
+        {
+          int from = cell - j;
+          if (!finishing[from] && !has_transition (&board->cells[from]))
             {
-              free (cells[j]);
+              finishing[from] = true;
+              queue[tail++] = from;
+            }
+        }
+      for (int k = offsets[cell]; k < offsets[cell + 1]; k++)
+        {
+          if (!finishing[sources[k]])
+            {
+              finishing[sources[k]] = true;
+              queue[tail++] = sources[k];
             }
-          handle_error (ALLOCATION_ERROR_MASSAGE, NULL);
-          return EXIT_FAILURE;
         }
-      *(cells[i]) = (Cell) {i + 1, EMPTY, EMPTY};
     }
+  free (queue);
+  free (offsets);
+  free (sources);
+  return finishing;
+}
 
-  for (int i = 0; i < NUM_OF_TRANSITIONS; i++)
+/**
+ * Allocate a board of size empty cells.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int allocate_board (Board *board, int size, int dice_max)
+{
+  board->size = size;
+  board->dice_max = dice_max;
+  board->cells = malloc ((size_t) size * sizeof (Cell));
+  if (!board->cells)
     {
-      int from = transitions[i][0];
-      int to = transitions[i][1];
-      if (from < to)
+      return handle_error (ALLOCATION_ERROR_MASSAGE, NULL);
+    }
+  for (int i = 0; i < size; i++)
+    {
+      board->cells[i] = (Cell) {i + 1, EMPTY, EMPTY};
+    }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Read a board file: the number of cells and of dice faces, followed by a
+ * "from to" pair for every ladder and snake. Ladders and snakes may lead
+ * to one another, but a game must be able to finish from every cell.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int read_board (Board *board, const char *path)
+{
+  FILE *fp = fopen (path, "r");
+  int size, dice_max;
+  if (!fp || fscanf (fp, "%d %d", &size, &dice_max) != 2
+      || size < MIN_BOARD_SIZE || dice_max < 1)
+    {
+      if (fp)
         {
-          cells[from - 1]->ladder_to = to;
+          fclose (fp);
         }
-      else
+      return handle_error (BOARD_ERR_MSG, NULL);
+    }
+  if (allocate_board (board, size, dice_max) != EXIT_SUCCESS)
+    {
+      fclose (fp);
+      return EXIT_FAILURE;
+    }
+  int from, to, read;
+  while ((read = fscanf (fp, "%d %d", &from, &to)) == 2)
+    {
+      // the last cell ends the game, so it can't lead anywhere
+      if (from < 1 || from >= size || to < 1 || to > size || from == to
+          || has_transition (&board->cells[from - 1]))
         {
-          cells[from - 1]->snake_to = to;
+          break;
         }
+      add_transition (board, from, to);
+    }
+  fclose (fp);
+  if (read != EOF)
+    {
+      free (board->cells);
+      return handle_error (BOARD_ERR_MSG, NULL);
+    }
+  bool *finishing = find_finishing_cells (board);
+  if (!finishing)
+    {
+      free (board->cells);
+      return EXIT_FAILURE;
+    }
+  int cell = 0;
+  while (cell < board->size && finishing[cell])
+    {
+      cell++;
+    }
+  free (finishing);
+  if (cell < board->size)
+    {
+      free (board->cells);
+      return handle_error (BOARD_ERR_MSG, NULL);
     }
   return EXIT_SUCCESS;
 }
 
 /**
- * fills database
- * @param markov_chain
+ * Generate a board of size cells with a DICE_MAX faces dice, with a ladder
+ * and a snake for every TRANSITION_CELLS cells. No ladder or snake leads to
+ * another one, and the snakes a game couldn't finish from are left out.
  * @return EXIT_SUCCESS or EXIT_FAILURE
  */
-static int fill_database (MarkovChain *markov_chain)
+static int generate_board (Board *board, int size, uint64_t seed)
 {
-  Cell *cells[BOARD_SIZE];
-  if (create_board (cells) == EXIT_FAILURE)
+  if (size < MIN_BOARD_SIZE)
+    {
+      return handle_error (BOARD_ERR_MSG, NULL);
+    }
+  if (allocate_board (board, size, DICE_MAX) != EXIT_SUCCESS)
     {
       return EXIT_FAILURE;
     }
-  MarkovNode *from_node = NULL, *to_node = NULL;
-  size_t index_to;
-  for (size_t i = 0; i < BOARD_SIZE; i++)
+  Rng rng;
+  seed_rng (&rng, seed, BOARD_STREAM);
+  int transitions_num = size / TRANSITION_CELLS;
+  for (int i = 0; i < 2 * transitions_num; i++)
+    {
+      // the first and last cells, and the cells ladders and snakes lead
+      // to, stay empty
+      int from = 2 + get_random_number (&rng, size - 2);
+      int to = 0;
+      if (!has_transition (&board->cells[from - 1]))
+        {
+          to = i % 2 == 0
+               ? from + 1 + get_random_number (&rng, size - from)
+               : 1 + get_random_number (&rng, from - 1);
+        }
+      if (to == 0 || has_transition (&board->cells[to - 1])
+          || board->cells[from - 1].number == EMPTY)
+        {
+          continue;
+        }
+      add_transition (board, from, to);
+      // mark to as a target, so no ladder or snake starts there
+      board->cells[to - 1].number = EMPTY;
+    }
+  for (int i = 0; i < size; i++)
     {
-      add_to_database (markov_chain, cells[i]);
+      board->cells[i].number = i + 1;
     }
+  bool *finishing = find_finishing_cells (board);
+  if (!finishing)
+    {
+      free (board->cells);
+      return EXIT_FAILURE;
+    }
+  // only a snake a game can't finish from leads to cells it can't finish
+  // from, so with those left out, a game can finish from every cell
+  for (int i = 0; i < size; i++)
+    {
+      if (!finishing[i])
+        {
+          board->cells[i].snake_to = EMPTY;
+        }
+    }
+  free (finishing);
+  return EXIT_SUCCESS;
+}
 
-  for (size_t i = 0; i < BOARD_SIZE; i++)
+/**
+ * Create the board: read from options->board_path, generated if
+ * options->random_board_size is set, or the classic 100 cells board.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int create_board (Board *board, const Options *options,
+                         uint64_t seed)
+{
+  if (options->board_path)
     {
-      from_node = get_node_from_database (markov_chain, cells[i])->data;
+      return read_board (board, options->board_path);
+    }
+  if (options->random_board_size > 0)
+    {
+      return generate_board (board, options->random_board_size, seed);
+    }
+  if (allocate_board (board, BOARD_SIZE, DICE_MAX) != EXIT_SUCCESS)
+    {
+      return EXIT_FAILURE;
+    }
+  for (int i = 0; i < NUM_OF_TRANSITIONS; i++)
+    {
+      add_transition (board, transitions[i][0], transitions[i][1]);
+    }
+  return EXIT_SUCCESS;
+}
 
-      if (cells[i]->snake_to != EMPTY || cells[i]->ladder_to != EMPTY)
+/**
+ * fills database with the cells of the board, in order, so that the
+ * MarkovNode of cell i is markov_chain->states[i - 1]->data. Cells are
+ * looked up by that index instead of in the database, so this takes
+ * linear time in the size of the board.
+ * @param markov_chain
+ * @param board the board to play
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int fill_database (MarkovChain *markov_chain, const Board *board)
+{
+  for (int i = 0; i < board->size; i++)
+    {
+      if (!add_new_to_database (markov_chain, &board->cells[i],
+                                hash_cell (&board->cells[i])))
         {
-          index_to = MAX(cells[i]->snake_to, cells[i]->ladder_to) - 1;
-          to_node = get_node_from_database (markov_chain, cells[index_to])
-              ->data;
-          add_node_to_counter_list (from_node, to_node, markov_chain);
+          return EXIT_FAILURE;
         }
-      else
+    }
+
+  Node **states = markov_chain->states;
+  for (int i = 0; i < board->size; i++)
+    {
+      MarkovNode *from_node = states[i]->data;
+      const Cell *cell = &board->cells[i];
+      if (has_transition (cell))
+        {
+          int index_to = MAX(cell->snake_to, cell->ladder_to) - 1;
+          if (!add_node_to_counter_list (from_node, states[index_to]->data,
+                                         markov_chain))
+            {
+              return EXIT_FAILURE;
+            }
+          continue;
+        }
+      for (int j = 1; j <= board->dice_max && i + j < board->size; j++)
         {
-          for (int j = 1; j <= DICE_MAX; j++)
+          if (!add_node_to_counter_list (from_node, states[i + j]->data,
+                                         markov_chain))
             {
-              index_to = ((Cell *) (from_node->data))->number + j - 1;
-              if (index_to >= BOARD_SIZE)
-                {
-                  break;
-                }
-              to_node = get_node_from_database (markov_chain, cells[index_to])
-                  ->data;
-              add_node_to_counter_list (from_node, to_node, markov_chain);
+              return EXIT_FAILURE;
             }
         }
     }
-  // free temp arr
-  for (size_t i = 0; i < BOARD_SIZE; i++)
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Parse the optional arguments, after the seed and the number of routes.
+ * @return EXIT_SUCCESS if the arguments are valid, EXIT_FAILURE otherwise.
+ */
+static int parse_options (int argc, char *argv[], Options *options)
+{
+  *options = (Options) {false, false, -1, NULL, 0, false};
+  bool valid = argc >= ARGS_NUM;
+  for (int i = ARGS_NUM; valid && i < argc; i++)
+    {
+      bool has_value = i + 1 < argc;
+      if (strcmp (argv[i], ANALYZE_FLAG) == 0)
+        {
+          options->analyze = true;
+        }
+      else if (strcmp (argv[i], SIMULATE_FLAG) == 0)
+        {
+          options->simulate = true;
+        }
+      else if (strcmp (argv[i], POSITION_FLAG) == 0 && has_value)
+        {
+          options->position_steps = get_num_from_str (argv[++i]);
+          valid = options->position_steps >= 0;
+        }
+      else if (strcmp (argv[i], STATS_FLAG) == 0)
+        {
+          options->stats = true;
+        }
+      else if (strcmp (argv[i], BOARD_FLAG) == 0 && has_value)
+        {
+          options->board_path = argv[++i];
+        }
+      else if (strcmp (argv[i], RANDOM_BOARD_FLAG) == 0 && has_value)
+        {
+          options->random_board_size = get_num_from_str (argv[++i]);
+          valid = options->random_board_size > 0;
+        }
+      else
+        {
+          valid = false;
+        }
+    }
+  if (!valid || options->analyze + options->simulate
+                   + (options->position_steps >= 0) > 1
+      || (options->board_path && options->random_board_size))
     {
-      free (cells[i]);
+      fprintf (stdout, USAGE_ERR_MSG);
+      return EXIT_FAILURE;
     }
   return EXIT_SUCCESS;
 }
@@ -289,10 +701,12 @@ static MarkovChain *get_markov_chain ()
     }
 
   markov_chain->print_func = print_cell;
+  markov_chain->format_func = format_cell;
   markov_chain->comp_func = compare_cells;
   markov_chain->free_data = free_cell;
   markov_chain->copy_func = copy_cell;
   markov_chain->is_last = is_last_cell;
+  markov_chain->hash_func = hash_cell;
   return markov_chain;
 }
 
@@ -302,17 +716,181 @@ static MarkovChain *get_markov_chain ()
  * @param markov_chain a representation of a markov chain
  * @param routes_num number of routes to create
  * @param routes_size the max size for each route.
+ * @param rng the random number generator to draw from
+ * @return success/failure: true if the process was successful, false in
+ * case of an allocation or IO error.
  */
 
-static void generate_routes (MarkovChain *markov_chain,
+static bool generate_routes (MarkovChain *markov_chain,
                              int routes_num,
-                             int routes_size)
+                             int routes_size,
+                             Rng *rng)
 {
+  OutputBuffer buffer;
+  init_output_buffer (&buffer, STDOUT_FILENO);
   for (int j = 1; j <= routes_num; ++j)
     {
-      printf ("Random Walk %d: ", j);
-      generate_random_sequence (markov_chain,
-                                markov_chain->database->first->data,
-                                routes_size);
+      append_to_output (&buffer, ROUTE_PREFIX, sizeof (ROUTE_PREFIX) - 1);
+      append_number_to_output (&buffer, j);
+      append_to_output (&buffer, ROUTE_SEPARATOR,
+                        sizeof (ROUTE_SEPARATOR) - 1);
+      write_random_sequence (markov_chain,
+                             markov_chain->database->first->data,
+                             routes_size, rng, &buffer);
+    }
+  bool success = flush_output_buffer (&buffer);
+  free_output_buffer (&buffer);
+  return success;
+}
+
+/**
+ * Print the expected number of steps to finish the game from every cell,
+ * and the distribution of the number of steps from the first cell, up to
+ * where ANALYSIS_COVERAGE of the games have finished. A step is a move of
+ * the walk, so climbing a ladder or sliding down a snake is a step too.
+ * @param markov_chain the frozen chain of the board
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool analyze_game (MarkovChain *markov_chain)
+{
+  FrozenChain *frozen_chain = markov_chain->frozen;
+  double *expected = malloc (frozen_chain->states_length * sizeof (double));
+  double *distribution = malloc ((ANALYSIS_MAX_STEPS + 1) * sizeof (double));
+  uint32_t first = markov_chain->database->first->data->id;
+  if (!expected || !distribution
+      || !compute_expected_steps (frozen_chain, expected)
+      || !compute_steps_distribution (frozen_chain, first,
+                                      ANALYSIS_MAX_STEPS, distribution))
+    {
+      free (expected);
+      free (distribution);
+      return false;
+    }
+
+  printf ("Expected steps to finish:\n");
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      printf ("[%d] %.4f\n", ((Cell *) frozen_chain->data[i])->number,
+              expected[i]);
+    }
+  printf ("Steps to finish from [%d]:\n",
+          ((Cell *) frozen_chain->data[first])->number);
+  double cumulative = 0;
+  for (int step = 0; step <= ANALYSIS_MAX_STEPS
+                     && cumulative < ANALYSIS_COVERAGE; ++step)
+    {
+      cumulative += distribution[step];
+      if (distribution[step] > 0)
+        {
+          printf ("%d %.6f %.6f\n", step, distribution[step], cumulative);
+        }
+    }
+  free (expected);
+  free (distribution);
+  return true;
+}
+
+/**
+ * Print the probability of being on every cell after exactly steps steps
+ * from the first cell, on as many threads as there are CPUs. Finished games
+ * stay on the last cell, so its probability is that of finishing within
+ * steps steps.
+ * @param markov_chain the frozen chain of the board
+ * @param steps number of steps
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation or thread error.
+ */
+static bool print_position (MarkovChain *markov_chain, int steps)
+{
+  FrozenChain *frozen_chain = markov_chain->frozen;
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  double *distribution = malloc (frozen_chain->states_length
+                                 * sizeof (double));
+  uint32_t first = markov_chain->database->first->data->id;
+  if (!distribution
+      || !compute_k_step_distribution (frozen_chain, first, steps,
+                                       cpus < 1 ? 1 : (int) cpus,
+                                       distribution))
+    {
+      free (distribution);
+      return false;
+    }
+
+  printf ("Position after %d steps from [%d]:\n", steps,
+          ((Cell *) frozen_chain->data[first])->number);
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      if (distribution[i] > 0)
+        {
+          printf ("[%d] %.6f\n", ((Cell *) frozen_chain->data[i])->number,
+                  distribution[i]);
+        }
+    }
+  free (distribution);
+  return true;
+}
+
+/**
+ * Simulate games_num games from the first cell, on as many threads as
+ * there are CPUs, and print the number of steps (transitions) per second,
+ * the mean number of steps to finish, its histogram and the mean number of
+ * visits to every cell per game.
+ * @param markov_chain the frozen chain of the board
+ * @param seed the seed of the games' random streams
+ * @param games_num number of games
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
+ */
+static bool simulate_games (MarkovChain *markov_chain, uint64_t seed,
+                            int games_num)
+{
+  FrozenChain *frozen_chain = markov_chain->frozen;
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  struct timespec start, end;
+  SimulationResult result;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  if (!simulate_frozen_chain (frozen_chain,
+                              markov_chain->database->first->data->id,
+                              games_num < 0 ? 0 : (uint64_t) games_num,
+                              SIMULATION_MAX_STEPS, seed,
+                              cpus < 1 ? 1 : (int) cpus, &result))
+    {
+      return false;
+    }
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  double seconds = (double) (end.tv_sec - start.tv_sec)
+                   + (double) (end.tv_nsec - start.tv_nsec) / NANOS_IN_SECOND;
+
+  double total_steps = 0;
+  for (int k = 0; k <= result.max_steps; ++k)
+    {
+      total_steps += (double) k * (double) result.lengths[k];
+    }
+  uint64_t finished = result.walks - result.unfinished;
+  printf ("Games: %llu (%llu unfinished)\n",
+          (unsigned long long) result.walks,
+          (unsigned long long) result.unfinished);
+  printf ("Steps: %llu in %.3f s (%.0f per second)\n",
+          (unsigned long long) result.transitions, seconds,
+          seconds > 0 ? (double) result.transitions / seconds : 0);
+  printf ("Mean steps to finish: %.4f\n",
+          finished > 0 ? total_steps / (double) finished : 0);
+  printf ("Steps to finish:\n");
+  for (int k = 0; k <= result.max_steps; ++k)
+    {
+      if (result.lengths[k] > 0)
+        {
+          printf ("%d %llu\n", k, (unsigned long long) result.lengths[k]);
+        }
+    }
+  printf ("Visits per game:\n");
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      printf ("[%d] %.4f\n", ((Cell *) frozen_chain->data[i])->number,
+              result.walks > 0 ? (double) result.visits[i]
+                                 / (double) result.walks : 0);
     }
+  free_simulation_result (&result);
+  return true;
 }
@@ -0,0 +1,177 @@
+#include "snapshot_chain.h"
+#include "markov_stats.h"
+
+#define FIRST_EPOCH 1
+
+/**
+ * Build a snapshot of markov_chain, with its tokens formatted if
+ * markov_chain has a format_func.
+ * @return the snapshot, NULL in case of allocation error.
+ */
+static FrozenChain *take_snapshot (MarkovChain *markov_chain)
+{
+  FrozenChain *frozen_chain = create_frozen_chain (markov_chain);
+  if (frozen_chain && markov_chain->format_func
+      && !format_frozen_tokens (frozen_chain, markov_chain->format_func))
+    {
+      free_frozen_chain (&frozen_chain);
+    }
+  return frozen_chain;
+}
+
+SnapshotChain *create_snapshot_chain (MarkovChain *markov_chain)
+{
+  SnapshotChain *snapshot_chain = calloc (1, sizeof (SnapshotChain));
+  if (!snapshot_chain)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return NULL;
+    }
+  COUNT_STAT (allocations, 1);
+  COUNT_STAT (bytes_allocated, sizeof (SnapshotChain));
+  snapshot_chain->current = take_snapshot (markov_chain);
+  if (!snapshot_chain->current)
+    {
+      free (snapshot_chain);
+      return NULL;
+    }
+  snapshot_chain->markov_chain = markov_chain;
+  snapshot_chain->epoch = FIRST_EPOCH;
+  return snapshot_chain;
+}
+
+/**
+ * @return the smallest epoch a reader is in, UINT64_MAX if none is in any.
+ */
+static uint64_t get_oldest_reader_epoch (const SnapshotChain *snapshot_chain)
+{
+  uint64_t oldest = UINT64_MAX;
+  SnapshotReader *reader = __atomic_load_n (&snapshot_chain->readers,
+                                            __ATOMIC_SEQ_CST);
+  for (; reader; reader = reader->next)
+    {
+      uint64_t epoch = __atomic_load_n (&reader->epoch, __ATOMIC_SEQ_CST);
+      if (epoch != 0 && epoch < oldest)
+        {
+          oldest = epoch;
+        }
+    }
+  return oldest;
+}
+
+/**
+ * Free the retired snapshots that no reader is in: those that were
+ * replaced at an epoch no later than the oldest epoch a reader is in,
+ * since readers enter the epoch before they read the current snapshot.
+ */
+static void reclaim_snapshots (SnapshotChain *snapshot_chain)
+{
+  uint64_t oldest = get_oldest_reader_epoch (snapshot_chain);
+  RetiredSnapshot **link = &snapshot_chain->retired;
+  while (*link)
+    {
+      RetiredSnapshot *retired = *link;
+      if (retired->epoch > oldest)
+        {
+          link = &retired->next;
+          continue;
+        }
+      *link = retired->next;
+      free_frozen_chain (&retired->frozen_chain);
+      free (retired);
+    }
+}
+
+void free_snapshot_chain (SnapshotChain **snapshot_chain)
+{
+  if (!snapshot_chain || !*snapshot_chain)
+    {
+      return;
+    }
+  SnapshotChain *chain = *snapshot_chain;
+  while (chain->retired)
+    {
+      RetiredSnapshot *next = chain->retired->next;
+      free_frozen_chain (&chain->retired->frozen_chain);
+      free (chain->retired);
+      chain->retired = next;
+    }
+  while (chain->readers)
+    {
+      SnapshotReader *next = chain->readers->next;
+      free (chain->readers);
+      chain->readers = next;
+    }
+  free_frozen_chain (&chain->current);
+  if (chain->markov_chain)
+    {
+      free_markov_chain (&chain->markov_chain);
+    }
+  free (chain);
+  *snapshot_chain = NULL;
+}
+
+bool publish_snapshot (SnapshotChain *snapshot_chain)
+{
+  FrozenChain *frozen_chain = take_snapshot (snapshot_chain->markov_chain);
+  RetiredSnapshot *retired = malloc (sizeof (RetiredSnapshot));
+  if (!frozen_chain || !retired)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      free_frozen_chain (&frozen_chain);
+      free (retired);
+      return false;
+    }
+  COUNT_STAT (allocations, 1);
+  COUNT_STAT (bytes_allocated, sizeof (RetiredSnapshot));
+  // readers that enter from the new epoch on can only see the new
+  // snapshot, so the old one is retired at it
+  retired->frozen_chain = __atomic_exchange_n (&snapshot_chain->current,
+                                               frozen_chain,
+                                               __ATOMIC_SEQ_CST);
+  retired->epoch = __atomic_add_fetch (&snapshot_chain->epoch, 1,
+                                       __ATOMIC_SEQ_CST);
+  retired->next = snapshot_chain->retired;
+  snapshot_chain->retired = retired;
+  reclaim_snapshots (snapshot_chain);
+  return true;
+}
+
+SnapshotReader *register_snapshot_reader (SnapshotChain *snapshot_chain)
+{
+  SnapshotReader *reader = malloc (sizeof (SnapshotReader));
+  if (!reader)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return NULL;
+    }
+  COUNT_STAT (allocations, 1);
+  COUNT_STAT (bytes_allocated, sizeof (SnapshotReader));
+  reader->epoch = 0;
+  reader->next = __atomic_load_n (&snapshot_chain->readers,
+                                  __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n (&snapshot_chain->readers,
+                                       &reader->next, reader, true,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+    }
+  return reader;
+}
+
+const FrozenChain *enter_snapshot (SnapshotChain *snapshot_chain,
+                                   SnapshotReader *reader)
+{
+  // the epoch is announced before the snapshot is read, so that a
+  // publish_snapshot that doesn't see the announcement has replaced the
+  // snapshot before it is read
+  __atomic_store_n (&reader->epoch,
+                    __atomic_load_n (&snapshot_chain->epoch,
+                                     __ATOMIC_SEQ_CST),
+                    __ATOMIC_SEQ_CST);
+  return __atomic_load_n (&snapshot_chain->current, __ATOMIC_SEQ_CST);
+}
+
+void leave_snapshot (SnapshotReader *reader)
+{
+  __atomic_store_n (&reader->epoch, 0, __ATOMIC_RELEASE);
+}
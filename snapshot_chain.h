@@ -0,0 +1,110 @@
+#ifndef _SNAPSHOT_CHAIN_H_
+#define _SNAPSHOT_CHAIN_H_
+#include "frozen_chain.h"
+
+/**
+ * A reader of a SnapshotChain: the epoch it entered at, 0 while it is not
+ * in a snapshot. Every thread that reads gets its own, see
+ * register_snapshot_reader.
+ */
+typedef struct SnapshotReader {
+    uint64_t epoch;
+    struct SnapshotReader *next;
+} SnapshotReader;
+
+/**
+ * A snapshot that was replaced, and may still be read by readers that
+ * entered before the epoch it was replaced at.
+ */
+typedef struct RetiredSnapshot {
+    FrozenChain *frozen_chain;
+    uint64_t epoch;
+    struct RetiredSnapshot *next;
+} RetiredSnapshot;
+
+/**
+ * A MarkovChain that keeps growing while other threads generate out of
+ * read-only snapshots of it. The writer updates markov_chain, which no
+ * reader ever touches, with the usual functions (add_to_database,
+ * add_node_to_counter_list...), and publish_snapshot then publishes a
+ * FrozenChain of all its updates so far with a single atomic store.
+ * Readers take no locks: they announce the epoch they enter at, read the
+ * current snapshot, and leave. A replaced snapshot is freed by a later
+ * publish_snapshot, once every reader has left the epochs it was current
+ * in, so a reader never sees memory go away under it, and never waits for
+ * the writer.
+ * Only one thread may update markov_chain and publish at a time.
+ * Publishing is not incremental: markov_chain is the whole chain, not the
+ * updates since the last snapshot, and every snapshot is built from all of
+ * it, in time linear in its states and transitions.
+ */
+typedef struct SnapshotChain {
+    MarkovChain *markov_chain;
+
+    // the snapshot readers enter, never NULL
+    FrozenChain *current;
+
+    // incremented by every publish_snapshot, starts at 1
+    uint64_t epoch;
+
+    // every registered reader, pushed with compare and swap
+    SnapshotReader *readers;
+
+    // the replaced snapshots that weren't freed yet (the writer's)
+    RetiredSnapshot *retired;
+} SnapshotChain;
+
+/**
+ * Create a SnapshotChain around markov_chain, and publish its first
+ * snapshot. The SnapshotChain owns markov_chain from now on.
+ * @param markov_chain the chain to update and take snapshots of
+ * @return the chain, NULL in case of allocation error (markov_chain is
+ * left to the caller).
+ */
+SnapshotChain *create_snapshot_chain (MarkovChain *markov_chain);
+
+/**
+ * Free the chain, its snapshots, its readers and its MarkovChain (unless
+ * markov_chain was set to NULL, after a failed add_to_database freed it).
+ * No other thread may use it.
+ * @param snapshot_chain the chain to free
+ */
+void free_snapshot_chain (SnapshotChain **snapshot_chain);
+
+/**
+ * Publish a snapshot of markov_chain as it is now, and free the replaced
+ * snapshots that no reader can see any more. The snapshot is rebuilt from
+ * the whole chain (and its tokens formatted, if markov_chain has a
+ * format_func) before it is published, so readers keep reading the last
+ * one meanwhile.
+ * @param snapshot_chain the chain
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error (the last snapshot stays current).
+ */
+bool publish_snapshot (SnapshotChain *snapshot_chain);
+
+/**
+ * Register a new reader, for a single thread to enter snapshots with. It
+ * lives as long as the chain.
+ * @param snapshot_chain the chain
+ * @return the reader, NULL in case of allocation error.
+ */
+SnapshotReader *register_snapshot_reader (SnapshotChain *snapshot_chain);
+
+/**
+ * Enter the current snapshot. It stays valid, and never changes, until
+ * leave_snapshot. A reader may be in a single snapshot at a time.
+ * @param snapshot_chain the chain
+ * @param reader the reader of the calling thread
+ * @return the snapshot
+ */
+const FrozenChain *enter_snapshot (SnapshotChain *snapshot_chain,
+                                   SnapshotReader *reader);
+
+/**
+ * Leave the snapshot the reader entered, which may be freed from now on.
+ * @param reader the reader of the calling thread
+ */
+void leave_snapshot (SnapshotReader *reader);
+
+#endif /* _SNAPSHOT_CHAIN_H_ */
@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200112L // For posix_madvise()
+
+#include <fcntl.h>    // For open()
+#include <sys/mman.h> // For mmap()
+#include <sys/stat.h> // For fstat()
+#include <unistd.h>   // For close()
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "tokenizer.h"
+
+/**
+ * @return true if c is one of DELIMITERS
+ */
+static bool is_delimiter (char c)
+{
+  return c == ' ' || c == '\n' || c == '\r';
+}
+
+void init_tokenizer (Tokenizer *tokenizer, const char *buffer, size_t size)
+{
+  tokenizer->pos = buffer;
+  tokenizer->end = buffer + size;
+}
+
+bool get_next_word (Tokenizer *tokenizer, WordView *word, bool *new_line)
+{
+  const char *pos = tokenizer->pos;
+  // runs of delimiters are short, so they are skipped one byte at a time
+  while (pos < tokenizer->end && is_delimiter (*pos))
+    {
+      if (*pos == '\n')
+        {
+          *new_line = true;
+        }
+      pos++;
+    }
+  if (pos == tokenizer->end)
+    {
+      tokenizer->pos = pos;
+      return false;
+    }
+  const char *word_end = find_delimiter (pos, tokenizer->end);
+  *word = (WordView) {pos, (size_t) (word_end - pos)};
+  tokenizer->pos = word_end;
+  return true;
+}
+
+#if defined(__AVX2__)
+const char *find_delimiter (const char *begin, const char *end)
+{
+  const __m256i space = _mm256_set1_epi8 (' ');
+  const __m256i new_line = _mm256_set1_epi8 ('\n');
+  const __m256i carriage_return = _mm256_set1_epi8 ('\r');
+  for (; end - begin >= (long) sizeof (__m256i); begin += sizeof (__m256i))
+    {
+      __m256i chunk = _mm256_loadu_si256 ((const __m256i *) begin);
+      __m256i found = _mm256_or_si256 (
+          _mm256_cmpeq_epi8 (chunk, space),
+          _mm256_or_si256 (_mm256_cmpeq_epi8 (chunk, new_line),
+                           _mm256_cmpeq_epi8 (chunk, carriage_return)));
+      unsigned int mask = (unsigned int) _mm256_movemask_epi8 (found);
+      if (mask)
+        {
+          return begin + __builtin_ctz (mask);
+        }
+    }
+  while (begin < end && !is_delimiter (*begin))
+    {
+      begin++;
+    }
+  return begin;
+}
+#elif defined(__SSE2__)
+const char *find_delimiter (const char *begin, const char *end)
+{
+  const __m128i space = _mm_set1_epi8 (' ');
+  const __m128i new_line = _mm_set1_epi8 ('\n');
+  const __m128i carriage_return = _mm_set1_epi8 ('\r');
+  for (; end - begin >= (long) sizeof (__m128i); begin += sizeof (__m128i))
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *) begin);
+      __m128i found = _mm_or_si128 (
+          _mm_cmpeq_epi8 (chunk, space),
+          _mm_or_si128 (_mm_cmpeq_epi8 (chunk, new_line),
+                        _mm_cmpeq_epi8 (chunk, carriage_return)));
+      unsigned int mask = (unsigned int) _mm_movemask_epi8 (found);
+      if (mask)
+        {
+          return begin + __builtin_ctz (mask);
+        }
+    }
+  while (begin < end && !is_delimiter (*begin))
+    {
+      begin++;
+    }
+  return begin;
+}
+#else
+const char *find_delimiter (const char *begin, const char *end)
+{
+  while (begin < end && !is_delimiter (*begin))
+    {
+      begin++;
+    }
+  return begin;
+}
+#endif
+
+bool map_file (const char *path, MappedFile *file)
+{
+  *file = (MappedFile) {NULL, 0};
+  int fd = open (path, O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat (fd, &file_stat) != 0)
+    {
+      if (fd >= 0)
+        {
+          close (fd);
+        }
+      return false;
+    }
+  file->size = (size_t) file_stat.st_size;
+  if (file->size == 0)
+    {
+      // nothing to map, an empty file has no words
+      close (fd);
+      return true;
+    }
+  void *data = mmap (NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      file->size = 0;
+      return false;
+    }
+  posix_madvise (data, file->size, POSIX_MADV_SEQUENTIAL);
+  file->data = data;
+  return true;
+}
+
+void unmap_file (MappedFile *file)
+{
+  if (file->data)
+    {
+      munmap ((void *) file->data, file->size);
+    }
+  *file = (MappedFile) {NULL, 0};
+}
@@ -0,0 +1,72 @@
+#ifndef _TOKENIZER_H_
+#define _TOKENIZER_H_
+#include <stdbool.h> // for bool
+#include <stddef.h> // For size_t
+
+#define DELIMITERS " \n\r"
+
+/**
+ * A word inside a larger buffer: not null terminated, and valid as long as
+ * the buffer is.
+ */
+typedef struct WordView {
+    const char *str;
+    size_t length;
+} WordView;
+
+/**
+ * Splits a buffer into words separated by DELIMITERS, without copying it.
+ */
+typedef struct Tokenizer {
+    const char *pos;
+    const char *end;
+} Tokenizer;
+
+/**
+ * A file mapped into memory, read only.
+ */
+typedef struct MappedFile {
+    const char *data;
+    size_t size;
+} MappedFile;
+
+/**
+ * Start splitting the size bytes at buffer.
+ * @param tokenizer the tokenizer to initialize
+ * @param buffer the buffer to split
+ * @param size size of the buffer
+ */
+void init_tokenizer (Tokenizer *tokenizer, const char *buffer, size_t size);
+
+/**
+ * Find the next word.
+ * @param tokenizer
+ * @param word the word to fill
+ * @param new_line set to true if a new line started before the word, left
+ *        untouched otherwise
+ * @return true if a word was found, false at the end of the buffer
+ */
+bool get_next_word (Tokenizer *tokenizer, WordView *word, bool *new_line);
+
+/**
+ * Find the first delimiter in [begin, end), 16 or 32 bytes at a time
+ * where SSE2 or AVX2 is available.
+ * @return pointer to the delimiter, end if there is none
+ */
+const char *find_delimiter (const char *begin, const char *end);
+
+/**
+ * Map a whole file into memory.
+ * @param path the file to map
+ * @param file the mapped file to fill
+ * @return success/failure: true if the process was successful, false if the
+ * file couldn't be opened or mapped.
+ */
+bool map_file (const char *path, MappedFile *file);
+
+/**
+ * Unmap a file mapped by map_file.
+ */
+void unmap_file (MappedFile *file);
+
+#endif //_TOKENIZER_H_
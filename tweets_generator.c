@@ -1,85 +1,296 @@
+#define _POSIX_C_SOURCE 200112L // For sysconf()
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "markov_chain.h"
+#include "frozen_chain.h"
+#include "batch_generator.h"
+#include "markov_analytics.h"
+#include "concurrent_chain.h"
+#include "markov_stats.h"
+#include "arena.h"
+#include "tokenizer.h"
+#include "output_buffer.h"
 
 #define FILE_ERR_MSG "ERROR: The given file is invalid.\n"
 #define USAGE_ERR_MSG "USAGE: Incorrect num of arguments"
-#define DELIMITERS " \n\r"
+#define LOAD_FLAG "--load"
+#define SAVE_FLAG "--save"
+#define THREADS_FLAG "--threads"
+#define STATIONARY_FLAG "--stationary"
+#define STATS_FLAG "--stats"
+#define CONCURRENT_FLAG "--concurrent"
 #define DECIMAL_BASE 10
-#define MIN_ARGS_NUM 4
-#define MAX_ARGS_NUM 5
+#define FIRST_OPTIONAL_ARG 3
+#define MAX_POSITIONAL_ARGS 2
+#define MAX_THREADS 64
+#define MIN_SHARD_SIZE 65536
+// bytes of corpus per bucket of the shared chain of --concurrent
+#define BYTES_PER_BUCKET 32
 #define MAX_TWEET_LENGTH 20
-#define BUFFER_LENGTH 1000
+#define FNV_OFFSET_BASIS 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+#define TWEET_PREFIX "Tweet "
+#define TWEET_SEPARATOR ": "
+#define STATIONARY_TOLERANCE 1e-12
+#define STATIONARY_MAX_ITERATIONS 100000
+#define PROBABILITY_TEXT_SIZE 32
+
+/**
+ * The command line arguments, other than the seed and number of tweets.
+ * Either model_to_load is set, or corpus_path is.
+ */
+typedef struct Arguments {
+    char *corpus_path;
+    char *words_to_read;
+    char *model_to_load;
+    char *model_to_save;
+    int threads;
+    // print the stationary distribution of the words instead of tweets
+    bool stationary;
+    // print the stats of markov_stats.h to stderr at the end
+    bool stats;
+    // build the chain with all the threads adding to a single shared chain
+    // (see fill_database_concurrently), instead of merging partial chains
+    bool concurrent;
+} Arguments;
 
-static int validate_args (int argc, char *argv[]);
+/**
+ * A part of the corpus that starts at the start of a line and ends at the
+ * end of one, and the partial chain its own thread builds out of it (or
+ * the shared chain it adds to, see fill_database_concurrently).
+ */
+typedef struct Shard {
+    const char *begin;
+    size_t size;
+    // max number of words to read from the shard, -1 for all
+    int words_to_read;
+    // number of words in the shard, see count_shard
+    int words_num;
+    MarkovChain *chain;
+    ConcurrentChain *concurrent_chain;
+    int status;
+} Shard;
+
+/**
+ * Where generate_tweets writes the tweets to.
+ */
+typedef struct TweetOutput {
+    const FrozenChain *frozen_chain;
+    OutputBuffer buffer;
+} TweetOutput;
+
+static int validate_args (int argc, char *argv[], Arguments *args);
 static int get_num_from_str (char *str);
-static Node *add_first_word_to_chain (MarkovChain *markov_chain, char *line);
-static int handle_line (MarkovChain *markov_chain,
-                        char *line,
-                        int words_left);
-static int fill_database (FILE *fp,
+static int fill_from_buffer (MarkovChain *markov_chain,
+                             const char *buffer,
+                             size_t size,
+                             int words_to_read);
+static int split_to_shards (MappedFile *file, int threads, Shard *shards);
+static int run_shards (Shard *shards, int shards_num,
+                       void *(*func) (void *));
+static void *count_shard (void *arg);
+static void *build_shard (void *arg);
+static void *feed_shard (void *arg);
+static void limit_shards (Shard *shards, int shards_num, int words_to_read);
+static int fill_database_in_shards (Shard *shards,
+                                    int shards_num,
+                                    int words_to_read,
+                                    MarkovChain *markov_chain);
+static int fill_database_concurrently (Shard *shards,
+                                       int shards_num,
+                                       int words_to_read,
+                                       size_t size,
+                                       MarkovChain *markov_chain);
+static int fill_database (char *path,
                            int words_to_read,
-                           MarkovChain *markov_chain);
-static void generate_tweets (MarkovChain *markov_chain,
+                           MarkovChain *markov_chain,
+                           int threads,
+                           bool concurrent);
+static bool use_chain (FrozenChain *frozen_chain,
+                       int tweets_num,
+                       uint64_t seed,
+                       const Arguments *args);
+static bool generate_tweets (FrozenChain *frozen_chain,
                       int tweets_num,
-                      int tweet_size);
-static int fill_database_wrapper (FILE *fp,
+                      uint64_t seed,
+                      int threads);
+static bool print_stationary_distribution (const FrozenChain *frozen_chain,
+                                           int threads);
+static void write_tweet (void *context, int index,
+                         const uint32_t *states, int length);
+static int generate_from_model (char *model_path,
+                                int tweets_num,
+                                uint64_t seed,
+                                const Arguments *args);
+static int fill_database_wrapper (char *path,
                             char *words_to_read_arg,
-                            MarkovChain *markov_chain);
+                            MarkovChain *markov_chain,
+                            int threads,
+                            bool concurrent);
 static MarkovChain *get_markov_chain ();
+static MarkovChain *get_partial_chain ();
+static ConcurrentChain *get_concurrent_chain (size_t expected_states);
 
-// functions for generic implementation
+// functions for generic implementation. The chain looks words up by
+// WordView (see fill_database), and stores them as interned strings.
 static void print_word (void *data);
+static size_t format_word (void *data, char *dest, size_t size);
 static int compare_words (void *ptr1, void *ptr2);
-static void free_word (void *data);
 static void *copy_word (void *ptr);
 static bool is_last_word (void *ptr);
+static unsigned long hash_word (void *ptr);
+static size_t word_size (void *ptr);
+static bool check_word (const void *ptr, size_t size);
+
+// functions for the partial chains, that store WordViews
+static int compare_views (void *ptr1, void *ptr2);
+static void *copy_view (void *ptr);
+static bool is_last_view (void *ptr);
+
+// the words of the chain, interned by copy_word
+static Arena word_arena;
 
 
 int main (int argc, char *argv[])
 {
-  if (validate_args (argc, argv) != 0)
+  Arguments args;
+  if (validate_args (argc, argv, &args) != 0)
     {
       return EXIT_FAILURE;
     }
 
-  // Set seed for rand
-  srand ((int) get_num_from_str (argv[1]));
+  // the seed of the tweets' random streams
+  uint64_t seed = (uint64_t) get_num_from_str (argv[1]);
   int tweets_num = get_num_from_str (argv[2]);
-  FILE *text_corpus = fopen (argv[3], "r");
+  if (args.model_to_load)
+    {
+      return generate_from_model (args.model_to_load, tweets_num, seed,
+                                  &args);
+    }
+  // from here on, every word of the chain lives in word_arena
+  start_stats_phase (INGEST_PHASE);
   MarkovChain *markov_chain = get_markov_chain ();
   if (!markov_chain)
     {
       return EXIT_FAILURE;
     }
-  if (fill_database_wrapper (text_corpus, argv[4], markov_chain) != 0) {
+  if (fill_database_wrapper (args.corpus_path, args.words_to_read,
+                             markov_chain, args.threads,
+                             args.concurrent) != 0) {
     return EXIT_FAILURE;
   }
+  if (!freeze_markov_chain (markov_chain)
+      || (args.model_to_save
+          && !save_frozen_chain (markov_chain->frozen, word_size,
+                                 args.model_to_save)))
+    {
+      free_markov_chain (&markov_chain);
+      free_arena (&word_arena);
+      return EXIT_FAILURE;
+    }
 
-  generate_tweets (markov_chain, tweets_num, MAX_TWEET_LENGTH);
+  end_stats_phase (INGEST_PHASE);
+
+  start_stats_phase (GENERATE_PHASE);
+  bool success = use_chain (markov_chain->frozen, tweets_num, seed, &args);
+  end_stats_phase (GENERATE_PHASE);
+  start_stats_phase (FREE_PHASE);
   free_markov_chain (&markov_chain);
+  free_arena (&word_arena);
+  end_stats_phase (FREE_PHASE);
+  if (args.stats)
+    {
+      print_markov_stats (stderr);
+    }
 
-  return EXIT_SUCCESS;
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 /**
- * Validate the arguments that the program received
+ * Validate the arguments that the program received, which are either
+ * 1) Seed 2) Number of tweets 3) Input file with tweets
+ * 4) Number of words to read (optional), with the optional flags
+ * "--save <model file>" and "--threads <number of threads>" anywhere
+ * after the number of tweets, or
+ * 1) Seed 2) Number of tweets 3) "--load" 4) Model file.
+ * "--stationary" may come with either, to print the stationary
+ * distribution of the words instead of tweets, and so may "--stats", to
+ * print the stats of markov_stats.h to stderr at the end.
+ * "--concurrent" may come with a corpus, to have the threads build a single
+ * shared chain (see fill_database_concurrently).
  * @param argc num of arguments
  * @param argv array of pointers to the arguments
+ * @param args the arguments to fill
  * @return EXIT_SUCCESS if the arguments are valid, EXIT_FAILURE
  * in case of invalid arguments.
  */
-static int validate_args (int argc, char *argv[])
+static int validate_args (int argc, char *argv[], Arguments *args)
 {
-  if (argc != MAX_ARGS_NUM && argc != MIN_ARGS_NUM)
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  *args = (Arguments) {NULL, NULL, NULL, NULL,
+                       cpus < 1 ? 1 : cpus > MAX_THREADS ? MAX_THREADS
+                                                         : (int) cpus,
+                       false, false, false};
+  char *positional[MAX_POSITIONAL_ARGS] = {NULL, NULL};
+  int positional_num = 0;
+  bool valid = argc > FIRST_OPTIONAL_ARG;
+  for (int i = FIRST_OPTIONAL_ARG; valid && i < argc; ++i)
+    {
+      bool has_value = i + 1 < argc;
+      if (strcmp (argv[i], LOAD_FLAG) == 0 && has_value)
+        {
+          args->model_to_load = argv[++i];
+        }
+      else if (strcmp (argv[i], SAVE_FLAG) == 0 && has_value)
+        {
+          args->model_to_save = argv[++i];
+        }
+      else if (strcmp (argv[i], THREADS_FLAG) == 0 && has_value)
+        {
+          args->threads = get_num_from_str (argv[++i]);
+          valid = args->threads > 0 && args->threads <= MAX_THREADS;
+        }
+      else if (strcmp (argv[i], STATIONARY_FLAG) == 0)
+        {
+          args->stationary = true;
+        }
+      else if (strcmp (argv[i], STATS_FLAG) == 0)
+        {
+          args->stats = true;
+        }
+      else if (strcmp (argv[i], CONCURRENT_FLAG) == 0)
+        {
+          args->concurrent = true;
+        }
+      else if (positional_num < MAX_POSITIONAL_ARGS
+               && strncmp (argv[i], "--", 2) != 0)
+        {
+          positional[positional_num++] = argv[i];
+        }
+      else
+        {
+          valid = false;
+        }
+    }
+  args->corpus_path = positional[0];
+  args->words_to_read = positional[1];
+  // either a model to load, or a corpus to train on
+  if (!valid || (args->model_to_load != NULL) == (positional_num > 0))
     {
       fprintf (stdout, USAGE_ERR_MSG);
       return EXIT_FAILURE;
     }
+  if (args->model_to_load)
+    {
+      return EXIT_SUCCESS;
+    }
 
-  FILE *text_corpus = fopen (argv[3], "r");
+  FILE *text_corpus = fopen (args->corpus_path, "r");
   if (!text_corpus)
     {
       fprintf (stderr, FILE_ERR_MSG);
@@ -101,128 +312,520 @@ static int get_num_from_str (char *str)
 }
 
 /**
- * Receives a line as a string and adds adds the first word in the line
- * to the markov chain (a line will always have at least two words).
- * @param markov_chain the database containing the markov chain.
- * @param line pointer to a string
- * @return markov_node wrapping given data_ptr in given chain's database,
- * returns NULL in case of memory allocation failure.
+ * Fills Markov Chain from a buffer of text. The chain gets views of its
+ * words, so nothing is copied but the words the chain keeps. Each word is
+ * followed by the next one on its line.
+ * @param markov_chain the database to fill
+ * @param buffer the text to read the words from
+ * @param size size of the text
+ * @param words_to_read max number of words to read, -1 for all
+ * @return EXIT_SUCCESS if the filling the database succeeded,
+ * EXIT_FAILURE otherwise.
  */
-static Node *add_first_word_to_chain (MarkovChain *markov_chain, char *line)
+static int fill_from_buffer (MarkovChain *markov_chain,
+                             const char *buffer,
+                             size_t size,
+                             int words_to_read)
 {
-  char *word;
-  word = strtok (line, DELIMITERS);
-  if (!word)
+  Tokenizer tokenizer;
+  init_tokenizer (&tokenizer, buffer, size);
+  WordView word;
+  bool new_line = false;
+  Node *prev = NULL;
+  while (words_to_read != 0
+         && get_next_word (&tokenizer, &word, &new_line))
     {
-      return NULL;
+      if (new_line)
+        {
+          prev = NULL;
+          new_line = false;
+        }
+      Node *curr = add_to_database (markov_chain, &word);
+      words_to_read--;
+      if (!curr)
+        {
+          // add_to_database already freed the chain
+          return EXIT_FAILURE;
+        }
+      if (prev && !add_node_to_counter_list (prev->data, curr->data,
+                                             markov_chain))
+        {
+          return EXIT_FAILURE;
+        }
+      prev = curr;
     }
-  return add_to_database (markov_chain, word);
+  return EXIT_SUCCESS;
 }
 
 /**
- * Receives a line as a string and adds all the data in the line to the
- * markov chain.
- * @param markov_chain the database containing the markov chain.
- * @param line pointer to a string
- * @param words_left the number of words left to read until reached the
- *                   wanted amount
- * @return number of words left to read after the line was handled
+ * Split the file to at most threads shards of whole lines, of at least
+ * MIN_SHARD_SIZE bytes each (but the last one).
+ * @param file the file to split
+ * @param threads max number of shards
+ * @param shards the shards to fill
+ * @return number of shards
  */
-static int handle_line (MarkovChain *markov_chain, char *line, int words_left)
+static int split_to_shards (MappedFile *file, int threads, Shard *shards)
 {
-  char *curr_word;
-  Node *n1 = add_first_word_to_chain (markov_chain, line);
-  words_left--;
+  size_t max_shards = file->size / MIN_SHARD_SIZE + 1;
+  size_t shards_num = (size_t) threads < max_shards ? (size_t) threads
+                                                    : max_shards;
+  const char *begin = file->data;
+  const char *file_end = file->data + file->size;
+  int count = 0;
+  for (size_t i = 1; i <= shards_num && begin < file_end; ++i)
+    {
+      const char *end = file_end;
+      if (i < shards_num)
+        {
+          const char *target = file->data + file->size / shards_num * i;
+          end = target > begin ? target : begin;
+          end = memchr (end, '\n', file_end - end);
+          end = end ? end + 1 : file_end;
+        }
+      shards[count++] = (Shard) {begin, (size_t) (end - begin), -1, 0,
+                                 NULL, NULL, EXIT_SUCCESS};
+      begin = end;
+    }
+  return count;
+}
 
-  curr_word = strtok (NULL, DELIMITERS);
-  while (curr_word && words_left != 0)
+/**
+ * Run func on every shard, each on its own thread, and wait for them all.
+ * @return EXIT_SUCCESS if func succeeded on all the shards, EXIT_FAILURE
+ * otherwise.
+ */
+static int run_shards (Shard *shards, int shards_num,
+                       void *(*func) (void *))
+{
+  pthread_t threads[MAX_THREADS];
+  int started = 0;
+  for (; started < shards_num; ++started)
     {
-      Node *n2 = add_to_database (markov_chain, curr_word);
-      words_left--;
-      if (!n1 || !n2)
+      if (pthread_create (&threads[started], NULL, func,
+                          &shards[started]) != 0)
         {
-          return words_left;
+          break;
         }
+    }
+  // shards that didn't get a thread run here
+  for (int i = started; i < shards_num; ++i)
+    {
+      func (&shards[i]);
+    }
+  int status = EXIT_SUCCESS;
+  for (int i = 0; i < shards_num; ++i)
+    {
+      if (i < started)
+        {
+          pthread_join (threads[i], NULL);
+        }
+      if (shards[i].status != EXIT_SUCCESS)
+        {
+          status = EXIT_FAILURE;
+        }
+    }
+  return status;
+}
 
-      if (!add_node_to_counter_list (n1->data, n2->data, markov_chain))
+/**
+ * Count the words of a shard (a thread's routine).
+ * @param arg the Shard
+ * @return NULL
+ */
+static void *count_shard (void *arg)
+{
+  Shard *shard = arg;
+  Tokenizer tokenizer;
+  init_tokenizer (&tokenizer, shard->begin, shard->size);
+  WordView word;
+  bool new_line;
+  shard->words_num = 0;
+  while (get_next_word (&tokenizer, &word, &new_line))
+    {
+      shard->words_num++;
+    }
+  return NULL;
+}
+
+/**
+ * Build the partial chain of a shard (a thread's routine).
+ * @param arg the Shard
+ * @return NULL
+ */
+static void *build_shard (void *arg)
+{
+  Shard *shard = arg;
+  shard->chain = get_partial_chain ();
+  if (!shard->chain
+      || fill_from_buffer (shard->chain, shard->begin, shard->size,
+                           shard->words_to_read) != EXIT_SUCCESS)
+    {
+      // the chain was freed by now, or is left for the process to exit
+      shard->chain = NULL;
+      shard->status = EXIT_FAILURE;
+    }
+  return NULL;
+}
+
+/**
+ * Add the words of a shard to the shared chain, like fill_from_buffer
+ * does to a MarkovChain (a thread's routine).
+ * @param arg the Shard
+ * @return NULL
+ */
+static void *feed_shard (void *arg)
+{
+  Shard *shard = arg;
+  Tokenizer tokenizer;
+  init_tokenizer (&tokenizer, shard->begin, shard->size);
+  WordView word;
+  bool new_line = false;
+  ConcurrentState *prev = NULL;
+  int words_to_read = shard->words_to_read;
+  while (words_to_read != 0
+         && get_next_word (&tokenizer, &word, &new_line))
+    {
+      if (new_line)
+        {
+          prev = NULL;
+          new_line = false;
+        }
+      ConcurrentState *curr = add_to_concurrent_chain (shard->concurrent_chain,
+                                                       &word);
+      words_to_read--;
+      if (!curr || (prev && !count_concurrent_transition (prev, curr)))
         {
-          free_markov_chain (&markov_chain);
+          shard->status = EXIT_FAILURE;
+          return NULL;
         }
+      prev = curr;
+    }
+  return NULL;
+}
 
-      n1 = n2;
-      curr_word = strtok (NULL, DELIMITERS);
+/**
+ * Limit the shards to the first words_to_read words of the file, shard by
+ * shard.
+ * @param shards the shards of the file
+ * @param shards_num number of shards
+ * @param words_to_read max number of words to read from file, -1 for all
+ */
+static void limit_shards (Shard *shards, int shards_num, int words_to_read)
+{
+  if (words_to_read < 0)
+    {
+      return;
     }
+  run_shards (shards, shards_num, count_shard);
+  for (int i = 0; i < shards_num; ++i)
+    {
+      int words = shards[i].words_num < words_to_read
+                  ? shards[i].words_num : words_to_read;
+      shards[i].words_to_read = words;
+      words_to_read -= words;
+    }
+}
 
-  return words_left;
+/**
+ * Fill the Markov Chain out of the shards, each one built by its own thread
+ * and then merged in order, so that the result is exactly the chain
+ * reading the whole file in one go would make.
+ * @param shards the shards of the file
+ * @param shards_num number of shards
+ * @param words_to_read max number of words to read from file, -1 for all
+ * @param markov_chain the database to fill
+ * @return EXIT_SUCCESS if the filling the database succeeded,
+ * EXIT_FAILURE otherwise.
+ */
+static int fill_database_in_shards (Shard *shards,
+                                    int shards_num,
+                                    int words_to_read,
+                                    MarkovChain *markov_chain)
+{
+  limit_shards (shards, shards_num, words_to_read);
+  int status = run_shards (shards, shards_num, build_shard);
+  for (int i = 0; i < shards_num; ++i)
+    {
+      if (status == EXIT_SUCCESS
+          && !merge_markov_chain (markov_chain, shards[i].chain))
+        {
+          // merge_markov_chain may have freed markov_chain by now
+          status = EXIT_FAILURE;
+        }
+      if (shards[i].chain)
+        {
+          free_markov_chain (&shards[i].chain);
+        }
+    }
+  return status;
 }
 
 /**
- * Fills Markov Chain from given input
- * @param fp file to read the words from
- * @param words_to_read max number of words to read from file
+ * Fill the Markov Chain out of the shards, all of their threads adding to
+ * a single ConcurrentChain at the same time, which is then copied into
+ * markov_chain. There is no merge, but the words get their ids in the
+ * order the threads happen to reach them, so the tweets of a seed may
+ * differ from run to run (the counts, and so the probabilities, do not).
+ * @param shards the shards of the file
+ * @param shards_num number of shards
+ * @param words_to_read max number of words to read from file, -1 for all
+ * @param size size of the file, to size the shared chain by
  * @param markov_chain the database to fill
  * @return EXIT_SUCCESS if the filling the database succeeded,
  * EXIT_FAILURE otherwise.
  */
-static int fill_database (FILE *fp,
+static int fill_database_concurrently (Shard *shards,
+                                       int shards_num,
+                                       int words_to_read,
+                                       size_t size,
+                                       MarkovChain *markov_chain)
+{
+  ConcurrentChain *concurrent_chain = get_concurrent_chain (
+      size / BYTES_PER_BUCKET + 1);
+  if (!concurrent_chain)
+    {
+      return EXIT_FAILURE;
+    }
+  limit_shards (shards, shards_num, words_to_read);
+  for (int i = 0; i < shards_num; ++i)
+    {
+      shards[i].concurrent_chain = concurrent_chain;
+    }
+  int status = run_shards (shards, shards_num, feed_shard);
+  if (status == EXIT_SUCCESS
+      && !copy_concurrent_chain (concurrent_chain, markov_chain))
+    {
+      // copy_concurrent_chain may have freed markov_chain by now
+      status = EXIT_FAILURE;
+    }
+  free_concurrent_chain (&concurrent_chain);
+  return status;
+}
+
+/**
+ * Fills Markov Chain from given input. The file is mapped into memory, and
+ * split between up to threads threads if it is large enough.
+ * @param path file to read the words from
+ * @param words_to_read max number of words to read from file, -1 for all
+ * @param markov_chain the database to fill
+ * @param threads max number of threads to use
+ * @param concurrent whether the threads fill a shared chain, see
+ *        fill_database_concurrently
+ * @return EXIT_SUCCESS if the filling the database succeeded,
+ * EXIT_FAILURE otherwise.
+ */
+static int fill_database (char *path,
                            int words_to_read,
-                           MarkovChain *markov_chain)
+                           MarkovChain *markov_chain,
+                           int threads,
+                           bool concurrent)
 {
-  char line[BUFFER_LENGTH];
-  if (!fp || words_to_read == 0)
+  MappedFile file;
+  if (words_to_read == 0 || !map_file (path, &file))
     {
       return EXIT_FAILURE;
     }
-  while (fgets (line, BUFFER_LENGTH, fp) && words_to_read != 0)
+  Shard shards[MAX_THREADS];
+  int shards_num = split_to_shards (&file, threads, shards);
+  int status = EXIT_SUCCESS;
+  if (shards_num > 1 && concurrent)
     {
-      words_to_read = handle_line (markov_chain, line, words_to_read);
+      status = fill_database_concurrently (shards, shards_num, words_to_read,
+                                           file.size, markov_chain);
     }
-  fclose (fp);
-  return EXIT_SUCCESS;
+  else if (shards_num > 1)
+    {
+      status = fill_database_in_shards (shards, shards_num, words_to_read,
+                                        markov_chain);
+    }
+  else
+    {
+      status = fill_from_buffer (markov_chain, file.data, file.size,
+                                 words_to_read);
+    }
+  unmap_file (&file);
+  return status;
+}
+
+/**
+ * Generate the tweets out of frozen_chain, or print its stationary
+ * distribution if args->stationary is set.
+ * @param frozen_chain a representation of a markov chain
+ * @param tweets_num number of tweets to create
+ * @param seed the seed of the tweets' random streams
+ * @param args the command line arguments
+ * @return success/failure: true if the process was successful, false in
+ * case of an error.
+ */
+static bool use_chain (FrozenChain *frozen_chain,
+                       int tweets_num,
+                       uint64_t seed,
+                       const Arguments *args)
+{
+  if (args->stationary)
+    {
+      return print_stationary_distribution (frozen_chain, args->threads);
+    }
+  return generate_tweets (frozen_chain, tweets_num, seed, args->threads);
 }
 
 /**
- * Receives a Markov Chain, generates and prints the amount of
- * tweets requested.
- * @param markov_chain a representation of a markov chain
+ * Receives a frozen Markov Chain, generates and prints the amount of
+ * tweets requested, on up to threads threads. The tweets only depend on
+ * the seed.
+ * @param frozen_chain a representation of a markov chain
  * @param tweets_num number of tweets to create
- * @param tweet_size the max size for each tweet.
+ * @param seed the seed of the tweets' random streams
+ * @param threads number of threads to generate on
+ * @return success/failure: true if the process was successful, false in
+ * case of allocation error.
  */
-static void generate_tweets (MarkovChain *markov_chain,
+static bool generate_tweets (FrozenChain *frozen_chain,
                       int tweets_num,
-                      int tweet_size)
+                      uint64_t seed,
+                      int threads)
 {
-  for (int j = 1; j <= tweets_num; ++j)
+  if (!frozen_chain->tokens
+      && !format_frozen_tokens (frozen_chain, format_word))
     {
-      printf ("Tweet %d: ", j);
-      generate_random_sequence (markov_chain,
-                                get_first_random_node (markov_chain),
-                                tweet_size);
+      return false;
     }
+  TweetOutput output = {frozen_chain, {0}};
+  init_output_buffer (&output.buffer, STDOUT_FILENO);
+  bool success = generate_frozen_batch (frozen_chain, seed, tweets_num,
+                                        MAX_TWEET_LENGTH, threads,
+                                        write_tweet, &output);
+  success = flush_output_buffer (&output.buffer) && success;
+  free_output_buffer (&output.buffer);
+  return success;
+}
+
+/**
+ * Append a single tweet to the output buffer (an emit_sequence of
+ * generate_frozen_batch). Errors stick to the buffer, see
+ * flush_output_buffer.
+ * @param context the TweetOutput
+ * @param index index of the tweet
+ * @param states ids of the words of the tweet
+ * @param length number of words
+ */
+static void write_tweet (void *context, int index,
+                         const uint32_t *states, int length)
+{
+  TweetOutput *output = context;
+  append_to_output (&output->buffer, TWEET_PREFIX,
+                    sizeof (TWEET_PREFIX) - 1);
+  append_number_to_output (&output->buffer, index + 1);
+  append_to_output (&output->buffer, TWEET_SEPARATOR,
+                    sizeof (TWEET_SEPARATOR) - 1);
+  write_frozen_states (output->frozen_chain, states, length,
+                       &output->buffer);
+}
+
+/**
+ * Print every word and its probability in the stationary distribution of
+ * the chain (see compute_stationary_distribution), in the order of the
+ * states.
+ * @param frozen_chain a representation of a markov chain
+ * @param threads max number of threads to compute on
+ * @return success/failure: true if the process was successful, false in
+ * case of an error.
+ */
+static bool print_stationary_distribution (const FrozenChain *frozen_chain,
+                                           int threads)
+{
+  double *distribution = malloc (((size_t) frozen_chain->states_length + 1)
+                                 * sizeof (double));
+  if (!distribution)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return false;
+    }
+  if (!compute_stationary_distribution (frozen_chain, STATIONARY_TOLERANCE,
+                                        STATIONARY_MAX_ITERATIONS, threads,
+                                        distribution))
+    {
+      free (distribution);
+      return false;
+    }
+  OutputBuffer buffer;
+  init_output_buffer (&buffer, STDOUT_FILENO);
+  for (uint32_t i = 0; i < frozen_chain->states_length; ++i)
+    {
+      char text[PROBABILITY_TEXT_SIZE];
+      int length = snprintf (text, PROBABILITY_TEXT_SIZE, " %.10g\n",
+                             distribution[i]);
+      const char *word = frozen_chain->data[i];
+      append_to_output (&buffer, word, strlen (word));
+      append_to_output (&buffer, text, length);
+    }
+  bool success = flush_output_buffer (&buffer);
+  free_output_buffer (&buffer);
+  free (distribution);
+  return success;
+}
+
+/**
+ * Load a model saved with "--save", and generate tweets out of it.
+ * @param model_path the model file
+ * @param tweets_num number of tweets to create
+ * @param seed the seed of the tweets' random streams
+ * @param args the command line arguments
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int generate_from_model (char *model_path,
+                                int tweets_num,
+                                uint64_t seed,
+                                const Arguments *args)
+{
+  start_stats_phase (INGEST_PHASE);
+  FrozenChain *frozen_chain = load_frozen_chain (model_path, check_word);
+  if (!frozen_chain)
+    {
+      return EXIT_FAILURE;
+    }
+  end_stats_phase (INGEST_PHASE);
+  start_stats_phase (GENERATE_PHASE);
+  bool success = use_chain (frozen_chain, tweets_num, seed, args);
+  end_stats_phase (GENERATE_PHASE);
+  start_stats_phase (FREE_PHASE);
+  free_frozen_chain (&frozen_chain);
+  end_stats_phase (FREE_PHASE);
+  if (args->stats)
+    {
+      print_markov_stats (stderr);
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 /**
  * Wrapper function to 'fill_database'. Helps send the correct parameters
  * based on whether you like it or not
- * @param fp file to read the words from
+ * @param path file to read the words from
  * @param words_to_read_arg pointer to str of max number of words to
  *                          read from file
  * @param markov_chain the database to fill
+ * @param threads max number of threads to use
+ * @param concurrent whether the threads fill a shared chain
  * @return EXIT_SUCCESS if the filling the database succeeded,
  * EXIT_FAILURE otherwise.
  */
-static int fill_database_wrapper (FILE *fp,
+static int fill_database_wrapper (char *path,
                             char *words_to_read_arg,
-                            MarkovChain *markov_chain)
+                            MarkovChain *markov_chain,
+                            int threads,
+                            bool concurrent)
 {
   if (words_to_read_arg)
     {
       int words_to_read = get_num_from_str (words_to_read_arg);
-      return fill_database (fp, words_to_read, markov_chain);
+      return fill_database (path, words_to_read, markov_chain, threads,
+                            concurrent);
     }
   else
     {
-      return fill_database (fp, -1, markov_chain);
+      return fill_database (path, -1, markov_chain, threads, concurrent);
     }
 }
 
@@ -241,14 +844,64 @@ static MarkovChain *get_markov_chain ()
     }
 
   markov_chain->print_func = print_word;
+  markov_chain->format_func = format_word;
   markov_chain->comp_func = compare_words;
-  markov_chain->free_data = free_word;
+  // words are freed all at once with word_arena
+  markov_chain->free_data = NULL;
   markov_chain->copy_func = copy_word;
   markov_chain->is_last = is_last_word;
+  markov_chain->hash_func = hash_word;
   return markov_chain;
 }
 
-// print
+/**
+ * Creates an instance of Markov Chain for a single shard of the corpus,
+ * that stores WordViews into the corpus instead of interned words, so it
+ * can be merged into the chain of get_markov_chain.
+ * @return a pointer to a MarkovChain, NULL if memory allocation failed.
+ */
+static MarkovChain *get_partial_chain ()
+{
+  MarkovChain *markov_chain = create_markov_chain();
+  if (!markov_chain)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      return NULL;
+    }
+
+  markov_chain->print_func = NULL;
+  markov_chain->comp_func = compare_views;
+  markov_chain->free_data = free;
+  markov_chain->copy_func = copy_view;
+  markov_chain->is_last = is_last_view;
+  markov_chain->hash_func = hash_word;
+  return markov_chain;
+}
+
+/**
+ * Creates a ConcurrentChain for all the shards of the corpus to add to at
+ * once, that stores WordViews like the chain of get_partial_chain.
+ * @param expected_states the number of words the chain is expected to get
+ * @return a pointer to a ConcurrentChain, NULL if memory allocation failed.
+ */
+static ConcurrentChain *get_concurrent_chain (size_t expected_states)
+{
+  ConcurrentChain *concurrent_chain = create_concurrent_chain (
+      expected_states);
+  if (!concurrent_chain)
+    {
+      return NULL;
+    }
+
+  concurrent_chain->comp_func = compare_views;
+  concurrent_chain->free_data = free;
+  concurrent_chain->copy_func = copy_view;
+  concurrent_chain->is_last = is_last_view;
+  concurrent_chain->hash_func = hash_word;
+  return concurrent_chain;
+}
+
+// print (kept for print_func, tweets are written with format_word)
 static void print_word (void *data)
 {
   printf ("%s", (char *) data);
@@ -258,28 +911,44 @@ static void print_word (void *data)
     }
 }
 
-// compare
-static int compare_words (void *ptr1, void *ptr2)
+// format (a word, followed by a space unless it ends the sentence). Works
+// on the words of loaded models too, which aren't interned.
+static size_t format_word (void *data, char *dest, size_t size)
 {
-  return strcmp ((char *) ptr1, (char *) ptr2);
+  const char *word = (char *) data;
+  size_t len = strlen (word);
+  size_t length = len + (word[len - 1] != '.');
+  if (length <= size)
+    {
+      memcpy (dest, word, len);
+      if (length > len)
+        {
+          dest[len] = ' ';
+        }
+    }
+  return length;
 }
 
-// free data
-static void free_word (void *data)
+// compare (an interned word of the chain to a WordView)
+static int compare_words (void *ptr1, void *ptr2)
 {
-  free ((char *) data);
+  const char *word = (char *) ptr1;
+  const WordView *view = (WordView *) ptr2;
+  size_t len = get_interned_length (word);
+  int result = memcmp (word, view->str,
+                       len < view->length ? len : view->length);
+  if (result != 0 || len == view->length)
+    {
+      return result;
+    }
+  return len < view->length ? -1 : 1;
 }
 
-// copy
+// copy (a WordView into an interned word)
 static void *copy_word (void *ptr)
 {
-  void *dest = calloc ((strlen ((char *) ptr) + 1), sizeof (char));
-  if (!dest)
-    {
-      return NULL;
-    }
-  memcpy (dest, ptr, strlen ((char *) ptr) + 1);
-  return dest;
+  const WordView *view = (WordView *) ptr;
+  return intern_string (&word_arena, view->str, view->length);
 }
 
 // is last
@@ -293,3 +962,61 @@ static bool is_last_word (void *ptr)
     }
   return false;
 }
+
+// hash (FNV-1a of a WordView)
+static unsigned long hash_word (void *ptr)
+{
+  const WordView *view = (WordView *) ptr;
+  const unsigned char *str = (const unsigned char *) view->str;
+  unsigned long hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < view->length; ++i)
+    {
+      hash = (hash ^ str[i]) * FNV_PRIME;
+    }
+  return hash;
+}
+
+// size
+static size_t word_size (void *ptr)
+{
+  return get_interned_length ((char *) ptr) + 1;
+}
+
+// check (a word loaded from a model file: not empty, and terminated)
+static bool check_word (const void *ptr, size_t size)
+{
+  return *(const char *) ptr != '\0' && memchr (ptr, '\0', size) != NULL;
+}
+
+// compare (two WordViews)
+static int compare_views (void *ptr1, void *ptr2)
+{
+  const WordView *view1 = (WordView *) ptr1;
+  const WordView *view2 = (WordView *) ptr2;
+  size_t len = view1->length < view2->length ? view1->length : view2->length;
+  int result = memcmp (view1->str, view2->str, len);
+  if (result != 0 || view1->length == view2->length)
+    {
+      return result;
+    }
+  return view1->length < view2->length ? -1 : 1;
+}
+
+// copy (a WordView)
+static void *copy_view (void *ptr)
+{
+  WordView *copy = malloc (sizeof (WordView));
+  if (!copy)
+    {
+      return NULL;
+    }
+  *copy = *(WordView *) ptr;
+  return copy;
+}
+
+// is last (a WordView)
+static bool is_last_view (void *ptr)
+{
+  const WordView *view = (WordView *) ptr;
+  return view->str[view->length - 1] == '.';
+}